@@ -0,0 +1,97 @@
+#!/bin/sh
+#
+# bench.sh - Compare the throughput of fractal, fractalthread and fractaltask
+#
+# Each engine renders a fixed set of views headless, and the best of
+# BENCH_RUNS runs is reported as one CSV line on standard output.
+# Speedup and efficiency are relative to the serial fractal on the same
+# view.  fractaltask-ms is fractaltask with Mariani-Silver subdivision.
+# Tile size 0 is fractaltask's adaptive tiles, reported as "adaptive",
+# against fixed tiles of 20 pixels and more.
+# The checksum of the iteration counts must match the serial one,
+# and the script fails if any engine computed a different image.
+#
+# BENCH_SIZE, BENCH_RUNS, BENCH_THREADS and BENCH_TILES change the sweep.
+
+SIZE=${BENCH_SIZE:-640x480}
+RUNS=${BENCH_RUNS:-3}
+NPROC=$(getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1)
+THREADS=${BENCH_THREADS:-"1 2 4 8 $NPROC"}
+TILES=${BENCH_TILES:-"0 10 20 40"}
+
+# name, view and maxiter of each benchmark, all with a 4:3 aspect
+VIEWS="full:-2.5,1,-1.3125,1.3125:500
+seahorse:-0.8,-0.7,0.05,0.125:2000
+deepzoom:-0.7436438870372,-0.7436438870370,0.1318259042052,0.13182590420535:5000
+interior:-0.4,0,-0.15,0.15:1000"
+
+# Sorted, distinct thread counts
+THREADS=$(echo $THREADS | tr ' ' '\n' | sort -n -u)
+
+status=0
+
+# Run one engine RUNS times and print the fastest "render:" line
+best() {
+	lines=
+	i=0
+	while [ $i -lt $RUNS ]; do
+		out=$("$@" -o /dev/null) || return 1
+		lines="$lines$(echo "$out" | grep '^render:')
+"
+		i=$((i+1))
+	done
+	printf '%s' "$lines" | sort -k4 -g | head -n 1
+}
+
+# Print the CSV line for one result, given the serial time and checksum.
+# Mariani-Silver fills rectangles it has not computed, so it may miss
+# details smaller than a pixel and its checksum is not required to match.
+report() {
+	case $2 in
+	*-ms) approx=approx ;;
+	*) approx=no; [ "$(echo "$5" | awk '{print $6}')" = "$8" ] || status=1 ;;
+	esac
+	echo "$5" | awk -v view="$1" -v engine="$2" -v threads="$3" -v tile="$4" \
+		-v maxiter="$6" -v base="$7" -v basesum="$8" -v approx=$approx '{
+		pixels = $2*$3; seconds = $4
+		speedup = base/seconds
+		printf "%s,%s,%d,%s,%d,%d,%d,%.6f,%.3f,%.3f,%.3f,%.3f,%s,%s\n",
+			view, engine, threads, tile, $2, $3, maxiter, seconds,
+			pixels/seconds/1e6, $5/seconds/1e6, speedup, speedup/threads,
+			$6, ($6 == basesum) ? "yes" : approx
+	}'
+}
+
+echo "view,engine,threads,tile,width,height,maxiter,seconds,mpixels_per_s,miters_per_s,speedup,efficiency,checksum,match"
+
+for entry in $VIEWS; do
+	name=${entry%%:*}
+	rest=${entry#*:}
+	view=${rest%%:*}
+	maxiter=${rest#*:}
+	args="-s $SIZE -v $view -m $maxiter"
+
+	line=$(best ./fractal $args) || exit 1
+	base=$(echo "$line" | awk '{print $4}')
+	basesum=$(echo "$line" | awk '{print $6}')
+	report $name fractal 1 - "$line" $maxiter $base $basesum
+
+	# The serial engine again without the cardioid and bulb test, to show its saving
+	line=$(best env MANDEL_INTERIOR=0 ./fractal $args) || exit 1
+	report $name fractal-nointerior 1 - "$line" $maxiter $base $basesum
+
+	for t in $THREADS; do
+		line=$(best ./fractalthread $args -t $t) || exit 1
+		report $name fractalthread $t - "$line" $maxiter $base $basesum
+		for tile in $TILES; do
+			label=$tile
+			[ "$tile" = 0 ] && label=adaptive
+			line=$(best ./fractaltask $args -t $t -T $tile) || exit 1
+			report $name fractaltask $t $label "$line" $maxiter $base $basesum
+			line=$(best ./fractaltask $args -t $t -T $tile -M) || exit 1
+			report $name fractaltask-ms $t $label "$line" $maxiter $base $basesum
+		done
+	done
+done
+
+exit $status
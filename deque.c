@@ -0,0 +1,94 @@
+/*
+deque.c - Chase-Lev work-stealing deque of task numbers
+
+This follows "Correct and Efficient Work-Stealing for Weak Memory Models"
+(Le, Pop, Cohen and Zappa Nardelli, 2013), using the GCC __atomic builtins.
+The buffer is fixed in size, so the caller must size it for the most tasks
+that can be queued at once.
+*/
+
+#include "deque.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+void deque_init( deque *d, long capacity )
+{
+	d->top = 0; 
+	d->bottom = 0; 
+	d->capacity = capacity; 
+	d->buffer = (int *) calloc (capacity, sizeof(int)); 
+	if (!d->buffer) {
+		fprintf(stderr, "deque_init: out of memory.\n"); 
+		exit(1); 
+	}
+}
+
+void deque_free( deque *d )
+{
+	free(d->buffer); 
+	d->buffer = 0; 
+}
+
+void deque_clear( deque *d )
+{
+	d->top = d->bottom; 
+}
+
+void deque_push( deque *d, int task )
+{
+	long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED); 
+	long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE); 
+
+	if (b - t >= d->capacity) {
+		fprintf(stderr, "deque_push: deque is full.\n"); 
+		exit(1); 
+	}
+
+	__atomic_store_n(&d->buffer[b % d->capacity], task, __ATOMIC_RELAXED); 
+	__atomic_thread_fence(__ATOMIC_RELEASE); 
+	__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED); 
+}
+
+int deque_pop( deque *d )
+{
+	long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1; 
+	__atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED); 
+	__atomic_thread_fence(__ATOMIC_SEQ_CST); 
+	long t = __atomic_load_n(&d->top, __ATOMIC_RELAXED); 
+	int task; 
+
+	if (t <= b) {
+		task = __atomic_load_n(&d->buffer[b % d->capacity], __ATOMIC_RELAXED); 
+		if (t == b) {
+			// Last task: race the thieves for it
+			if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+				task = DEQUE_EMPTY; 
+			}
+			__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED); 
+		}
+	} else {
+		task = DEQUE_EMPTY; 
+		__atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED); 
+	}
+
+	return task; 
+}
+
+int deque_steal( deque *d )
+{
+	long t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE); 
+	__atomic_thread_fence(__ATOMIC_SEQ_CST); 
+	long b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE); 
+
+	if (t >= b) {
+		return DEQUE_EMPTY; 
+	}
+
+	int task = __atomic_load_n(&d->buffer[t % d->capacity], __ATOMIC_RELAXED); 
+	if (!__atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+		return DEQUE_ABORT; 
+	}
+
+	return task; 
+}
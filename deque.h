@@ -0,0 +1,39 @@
+/*
+deque.h - Chase-Lev work-stealing deque of task numbers
+The owning thread pushes and pops at the bottom, and any
+other thread may steal from the top, all without locks.
+*/
+
+#ifndef DEQUE_H
+#define DEQUE_H
+
+#define DEQUE_EMPTY -1
+#define DEQUE_ABORT -2
+
+typedef struct {
+	long top; 
+	char pad[64-sizeof(long)]; 
+	long bottom; 
+	long capacity; 
+	int *buffer; 
+} deque; 
+
+/* Create an empty deque that holds up to capacity tasks at a time. */
+void deque_init( deque *d, long capacity );
+
+/* Free the memory of the deque. */
+void deque_free( deque *d );
+
+/* Drop every task in the deque.  No other thread may be using it. */
+void deque_clear( deque *d );
+
+/* Push a task at the bottom.  Only the owner may call this. */
+void deque_push( deque *d, int task );
+
+/* Pop the most recently pushed task, or return DEQUE_EMPTY.  Only the owner may call this. */
+int deque_pop( deque *d );
+
+/* Steal the oldest task.  Return DEQUE_EMPTY, or DEQUE_ABORT if another thread won the race for it. */
+int deque_steal( deque *d );
+
+#endif
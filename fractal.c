@@ -4,169 +4,92 @@ Starting code for CSE 30341 Project 3.
 */
 
 #include "gfx.h"
+#include "view.h"
+#include "itermap.h"
+#include "frame.h"
+#include "palette.h"
+#include "render.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <errno.h>
 #include <string.h>
-#include <complex.h>
+
+itermap frame_map; 
+frame frame_state; 
+palette frame_palette; 
+palette_pass color_pass; 
 
 /*
-Compute the number of iterations at point x, y
-in the complex space, up to a maximum of maxiter.
-Return the number of iterations at that point.
-
-This example computes the Mandelbrot fractal:
-z = z^2 + alpha
-
-Where z is initially zero, and alpha is the location x + iy
-in the complex plane.  Note that we are using the "complex"
-numeric type in C, which has the special functions cabs()
-and cpow() to compute the absolute values and powers of
-complex values.
+Color the whole last frame from its iteration map, equalizing the
+palette for it first if it is on.
 */
 
-static int compute_point( double x, double y, int max )
+void color_image()
 {
-	double complex z = 0;
-	double complex alpha = x + I*y;
-
-	int iter = 0;
-
-	while( cabs(z)<4 && iter < max ) {
-		z = cpow(z,2) + alpha;
-		iter++;
-	}
+	int width = gfx_xsize();
+	int height = gfx_ysize();
 
-	return iter;
+	palette_pass_begin(&color_pass,&frame_palette,frame_map.iters,frame_map.fracs,gfx_framebuffer(),width*height,frame_map.view.maxiter,1);
+	palette_pass_run(&color_pass);
 }
 
 /*
 Compute an entire image, writing each point to the given bitmap.
-Scale the image to the range (xmin-xmax,ymin-ymax).
+Scale the image to the range covered by the view.
 */
 
-void compute_image( double xmin, double xmax, double ymin, double ymax, int maxiter )
+void compute_image( const viewport *view )
 {
-	int i,j;
+	int j;
+	int left,top,w,h;
 
 	int width = gfx_xsize();
 	int height = gfx_ysize();
+	int iters[width];
+	unsigned int *pixels = gfx_framebuffer();
 
-	// For every pixel i,j, in the image...
-
-	for(j=0;j<height;j++) {
-		for(i=0;i<width;i++) {
+	// Only compute the pixels that the last frame cannot provide
+	itermap_begin(&frame_map,pixels,width,height,view,&left,&top,&w,&h);
+	frame_begin(&frame_state,view,&frame_map);
+	palette_build(&frame_palette,view->maxiter);
 
-			// Scale from pixels i,j to coordinates x,y
-			double x = xmin + i*(xmax-xmin)/width;
-			double y = ymin + j*(ymax-ymin)/height;
+	// For every pixel i,j, in the image...
 
-			// Compute the iterations at x,y
-			int iter = compute_point(x,y,maxiter);
+	for(j=top;j<top+h;j++) {
 
-			// Convert a iteration number to an RGB color.
-			// (Change this bit to get more interesting colors.)
-			int color = (255 * iter / maxiter)*4; 
-			int color2 = (255 * iter / maxiter); 
-			int color3 = (255 * iter / maxiter);
-			gfx_color(color,color2,color3);
+		// Compute the iterations for the whole row at once
+		frame_row(&frame_state,left,w,j,&iters[left]);
 
-			// Plot the point on the screen.
-			gfx_point(i,j);
-		}
+		// Store the row in the iteration map, and color it into the framebuffer
+		memcpy(&frame_map.iters[j*width+left],&iters[left],w*sizeof(int));
+		palette_map(&frame_palette,&iters[left],&frame_map.fracs[j*width+left],&pixels[j*width+left],w);
 	}
-}
+	itermap_end(&frame_map);
 
-// Move up function
-void move_up(double xmin, double xmax, double ymin, double ymax, int maxiter) {
-	double yrange = ymax-ymin; 
-	ymin -= yrange/4;
-	ymax -= yrange/4;  	
-	compute_image(xmin, xmax, ymin, ymax, maxiter); 
-	return; 
-}
-
-// Move down function
-void move_down(double xmin, double xmax, double ymin, double ymax, int maxiter) {
-	double yrange = ymax-ymin; 
-	ymin += yrange/4; 
-	ymax += yrange/4; 
-	compute_image(xmin, xmax, ymin, ymax, maxiter); 
-	return; 
-}
-
-// Move left function
-void move_left(double xmin, double xmax, double ymin, double ymax, int maxiter) {
-	double xrange = xmax-xmin; 
-	xmin -= xrange/4; 
-	xmax -= xrange/4; 
-	compute_image(xmin, xmax, ymin, ymax, maxiter); 
-	return; 
-}
-
-// Move right function
-void move_right(double xmin, double xmax, double ymin, double ymax, int maxiter) {
-	double xrange = xmax-xmin; 
-	xmin += xrange/4; 
-	xmax += xrange/4; 
-	compute_image(xmin, xmax, ymin, ymax, maxiter); 
-	return; 
-}
+	// Equalizing needs the counts of the whole frame
+	if(frame_palette.equalize) {
+		color_image();
+	}
 
-// Zoom in function
-void zoom_in(double xmin, double xmax, double ymin, double ymax, int maxiter) {
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin; 
-	xmin -= xrange/4; 
-	xmax -= xrange/4; 
-	ymin -= yrange/4; 
-	ymax -= yrange/4; 
-	compute_image(xmin, xmax, ymin, ymax, maxiter); 
-	return; 
+	// Show the whole image at once
+	gfx_blit(0,0,width,height);
 }
 
-// Zoom out function
-void zoom_out(double xmin, double xmax, double ymin, double ymax, int maxiter) {
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin; 
-	xmin += xrange/4; 
-	xmax += xrange/4; 
-	ymin += yrange/4; 
-	ymax += yrange/4; 
-	compute_image(xmin, xmax, ymin, ymax, maxiter); 
-	return; 
-}
+/*
+Color the iteration map of the last frame again, after the palette has
+changed, with no iterations to compute.
+*/
 
-// Recenter function
-void recenter(double xmin, double xmax, double ymin, double ymax, int maxiter) {
+void recolor_image()
+{
 	int width = gfx_xsize();
-	int height = gfx_ysize(); 
-	int xpos = gfx_xpos(); 
-	int ypos = gfx_ypos(); 
-
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin;
-
-	double xcenter = xmin + xrange * xpos / width; 
-	double ycenter = ymin + yrange * ypos / height;  
-
-	xmax = xcenter + xrange; 
-	xmin = xcenter - xrange; 
-	ymax = ycenter + yrange; 
-	ymin = ycenter - yrange; 
-
-	compute_image(xmin, xmax, ymin, ymax, maxiter); 
- 
-	return; 
-}
+	int height = gfx_ysize();
 
-// Change maxiter
-void change_maxiter(double xmin, double xmax, double ymin, double ymax, int maxiter) {
-	maxiter *= 5; 
-	compute_image(xmin, xmax, ymin, ymax, maxiter); 
-	return; 
+	palette_print(&frame_palette);
+	color_image();
+	gfx_blit(0,0,width,height);
 }
 
 int main( int argc, char *argv[] )
@@ -182,18 +105,38 @@ int main( int argc, char *argv[] )
 	// Higher values take longer but have more detail.
 	int maxiter=500;
 
-	// Open a new window.
-	gfx_open(640,480,"Mandelbrot Fractal");
+	// Let the command line change the view and the window size
+	render_options opts = { 0, 640, 480, {0}, 1, 0, 0, 0 };
+	view_init(&opts.view,xmin,xmax,ymin,ymax,maxiter);
+	render_parse(argc,argv,&opts);
+
+	// The view that the navigation commands move around
+	viewport view = opts.view; 
+
+	// Start with the colors this program has always had
+	palette_init(&frame_palette,0);
 
 	// Show the configuration, just in case you want to recreate it.
-	printf("coordinates: %lf %lf %lf %lf\n",xmin,xmax,ymin,ymax);
+	view_print(&view);
+
+	// With an output file, draw one frame in memory and write it out
+	if(opts.output) {
+		gfx_open_headless(opts.width,opts.height);
+		double start = render_time();
+		compute_image(&view);
+		render_report(frame_map.iters,opts.width,opts.height,render_time()-start);
+		exit(render_write(opts.output,gfx_framebuffer(),opts.width,opts.height) ? 1 : 0);
+	}
+
+	// Open a new window.
+	gfx_open(opts.width,opts.height,"Mandelbrot Fractal");
 
 	// Fill it with a dark blue initially.
 	gfx_clear_color(0,0,255);
 	gfx_clear();
 
 	// Display the fractal image
-	compute_image(xmin,xmax,ymin,ymax,maxiter);
+	compute_image(&view);
 
 	while(1) {
 		// Wait for a key or mouse click.
@@ -202,54 +145,86 @@ int main( int argc, char *argv[] )
 		switch (c) {
 			case ('r'):
 				// Move right
-				move_right(xmin, xmax, ymin, ymax, maxiter); 
+				view_move(&view, 0.25, 0); 
+				compute_image(&view); 
 				break;  
 			case ('l'):
 				// Move left
-				move_left(xmin, xmax, ymin, ymax, maxiter); 
+				view_move(&view, -0.25, 0); 
+				compute_image(&view); 
 				break;
 			case ('u'):
 				// Move up
-				move_up(xmin, xmax, ymin, ymax, maxiter); 
+				view_move(&view, 0, -0.25); 
+				compute_image(&view); 
 				break;  
 			case ('d'):
 				// Move down
-				move_down(xmin, xmax, ymin, ymax, maxiter); 
+				view_move(&view, 0, 0.25); 
+				compute_image(&view); 
 				break; 
 			case ('q'):
 				// Quit if q is pressed
 				exit(0); 
 			case ('i'): 
 				// Zoom in
-				zoom_in(xmin, xmax, ymin, ymax, maxiter); 
+				view_zoom(&view, 0.5); 
+				compute_image(&view); 
 				break;
 			case ('+'):
 				// Zoom in
-				zoom_in(xmin, xmax, ymin, ymax, maxiter); 
+				view_zoom(&view, 0.5); 
+				compute_image(&view); 
 				break; 
 			case ('o'):
 				// Zoom out
-				zoom_out(xmin, xmax, ymin, ymax, maxiter); 
+				view_zoom(&view, 2); 
+				compute_image(&view); 
 				break;
 			case ('-'):
 				// Zoom out
-				zoom_out(xmin, xmax, ymin, ymax, maxiter); 
+				view_zoom(&view, 2); 
+				compute_image(&view); 
 				break;
 			case (1):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				compute_image(&view); 
 				break;  
 			case (2):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				compute_image(&view); 
 				break; 
 			case (3):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				compute_image(&view); 
 				break; 
 			case ('m'):
 				// Change maxiter
-				change_maxiter(xmin, xmax, ymin, ymax, maxiter); 
+				view_change_maxiter(&view, 5); 
+				compute_image(&view); 
+				break; 
+			case ('c'):
+				// Next palette
+				palette_next_scheme(&frame_palette); 
+				recolor_image(); 
+				break; 
+			case ('x'):
+				// Next color scale
+				palette_next_scale(&frame_palette); 
+				recolor_image(); 
+				break; 
+			case ('n'):
+				// Toggle smooth coloring
+				palette_toggle_smooth(&frame_palette); 
+				recolor_image(); 
+				break; 
+			case ('e'):
+				// Toggle histogram equalization
+				palette_toggle_equalize(&frame_palette); 
+				recolor_image(); 
 				break; 
 			default:
 				break; 
@@ -3,280 +3,929 @@ fractal.c - Sample Mandelbrot Fractal Display
 Starting code for CSE 30341 Project 3.
 */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "gfx.h"
+#include "view.h"
+#include "pool.h"
+#include "deque.h"
+#include "itermap.h"
+#include "frame.h"
+#include "tilecache.h"
+#include "palette.h"
+#include "rectqueue.h"
+#include "render.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <errno.h>
 #include <string.h>
-#include <complex.h>
 #include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#define TILE_SIZE 20
+#define ADAPTIVE_TASKS 4
+#define MIN_SPLIT_SIZE 5
+#define STEAL_SPINS 64
+#define PROGRESSIVE_STEP 4
+#define SUBDIVIDE_MIN_SIZE 6
+#define SUBDIVIDE_TILES 4
+#define PRESENT_INTERVAL (1.0/60)
+#define PRESENT_QUEUE 16384
+#define CACHE_MB 64
 
-/*
-Compute the number of iterations at point x, y
-in the complex space, up to a maximum of maxiter.
-Return the number of iterations at that point.
-
-This example computes the Mandelbrot fractal:
-z = z^2 + alpha
-
-Where z is initially zero, and alpha is the location x + iy
-in the complex plane.  Note that we are using the "complex"
-numeric type in C, which has the special functions cabs()
-and cpow() to compute the absolute values and powers of
-complex values.
-*/
 typedef struct {
-	int done; 
 	int x; 
 	int y;  
+	int w; 
+	int h; 
+	int border_done; 
 } task_args; 
 
+/*
+All the tasks of one frame, in one contiguous array: the tiles first,
+then the sub-tiles made when a tile is split.  Each thread owns a
+work-stealing deque of task numbers, seeded with tiles spread across
+the whole image.  A thread runs tasks from its own deque, and when
+that is empty steals from the deque of a randomly chosen thread.
+pending counts the tasks still sitting in some deque.
+
+The image is cut into cells of the tile size, the last row and column
+of them clipped to the edges.  With fixed tiles every cell is a task.
+With adaptive tiles the frame starts from square blocks of cells, about
+ADAPTIVE_TASKS per thread, which keeps the number of tasks to schedule
+low, and once fewer tasks are pending than there are threads, every task
+taken is split into quarters, so the end of the frame stays balanced.
+
+In progressive mode a frame is drawn in passes.  The first pass computes
+one pixel in every step x step block and paints it over the whole block.
+Each later pass halves the step and computes only the pixels that no
+coarser pass has computed, until step is 1.  Tasks stay aligned to the
+step, so every block lies inside one task.
+
+In subdivide mode (Mariani-Silver) a task first computes the border of
+its rectangle.  Because the set is connected, a rectangle whose border
+has a single iteration count is filled with that count without
+computing its inside.  Otherwise the task computes a middle row and
+column and pushes the four quarters, whose borders are then all known,
+as new tasks.  active counts the tasks being run, which may still push
+more, so idle threads keep trying to steal until it reaches zero too.
+*/
+typedef struct {
+	task_args *tasks; 
+	int num_tasks; 
+	int capacity; 
+	int pending; 
+	int step; 
+	int first_step; 
+	int subdivide; 
+	int adaptive; 
+	int active; 
+	deque *deques; 
+	int num_deques; 
+} task_queue; 
+
+typedef struct {
+	double busy; 
+	int tasks; 
+	int steals; 
+	int failed_steals; 
+	int splits; 
+	int fills; 
+} thread_stats; 
+
 typedef struct {
-	double xmin; 
-	double xmax; 
-	double ymin; 
-	double ymax; 
+	const frame *frame; 
 	int maxiter; 
 	int num_threads;
-	task_args **tasks;  
+	int id; 
+	int epoch; 
+	unsigned int seed; 
+	task_queue *queue;  
+	unsigned int *pixels; 
+	int *iter_map; 
+	thread_stats stats; 
 } thread_args;  
 
-task_args **tasks; 
-pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;  
+/*
+Frames are drawn in the background while main keeps handling events.
+Starting a frame bumps frame_epoch, and a worker whose epoch no longer
+matches stops before its next task, so a new keypress cancels the frame
+in flight.
 
-static int compute_point( double x, double y, int max )
-{
-	double complex z = 0;
-	double complex alpha = x + I*y;
+main is also the only thread that touches the display.  Workers push
+the rectangles they finish onto the shown queue, and main draws
+whatever has been queued in one batch, with one flush, PRESENT_INTERVAL
+after the last batch, so a worker never waits on the X connection.  A
+worker that finds the queue full sets present_all instead, to draw the
+whole frame.
+*/
+rectqueue shown; 
+int present_all = 0; 
+double last_present = 0; 
+int show_stats = 0; 
+int tile_size = 0; // side of the square tiles a frame is cut into, set by -T, or 0 to adapt them
+int progressive = 0; 
+int subdivide = 0; 
+pool *workers; 
+task_queue queue; 
+thread_args *frame_args; 
+int frame_num_threads = 0; 
+itermap frame_map; 
+frame frame_state; 
+palette frame_palette; 
+palette_pass color_pass; 
+tilecache tile_cache; 
+char *tile_hits; // per tile of the frame in flight, whether it came from the cache
+int tile_hits_size = 0; 
+int frame_x, frame_y, frame_w, frame_h; 
+int frame_epoch = 0; 
+int frame_running = 0; 
+double frame_start; 
+
+// Queue a finished rectangle of the framebuffer to be shown, or filled with color if fill is set
+static void show(int x, int y, int w, int h, int fill, unsigned int color, int epoch) {
+	rect r = { x, y, w, h, fill, color, epoch }; 
+
+	if (!rectqueue_push(&shown, &r)) {
+		__atomic_store_n(&present_all, 1, __ATOMIC_RELEASE); 
+	}
+}
+
+/*
+Draw every rectangle queued so far, and flush them to the display.  A
+fill from a frame that has since been cancelled is copied from the
+framebuffer instead, since the next frame may have drawn over it.
+*/
+void present() {
+	rect r; 
+
+	while (rectqueue_pop(&shown, &r)) {
+		if (r.fill && r.epoch == frame_epoch) {
+			gfx_fill_rect(r.x, r.y, r.w, r.h, r.color); 
+		} else {
+			gfx_blit(r.x, r.y, r.w, r.h); 
+		}
+	}
+	if (__atomic_exchange_n(&present_all, 0, __ATOMIC_ACQUIRE)) {
+		gfx_blit(0, 0, gfx_xsize(), gfx_ysize()); 
+	}
+	gfx_flush(); 
+	last_present = render_time(); 
+}
+
+// Pick a random thread to steal from
+static int random_victim(thread_args *thread) {
+	unsigned int s = thread->seed; 
+	s ^= s << 13; 
+	s ^= s >> 17; 
+	s ^= s << 5; 
+	thread->seed = s; 
+	return s % thread->num_threads; 
+}
+
+/*
+Split a stolen task, or with adaptive tiles any task, into four
+quadrants when few tasks are left, so the end of the frame stays balanced.  Three quadrants go on our own deque,
+where other threads can steal them, and we return the one to run now.
+*/
+static int split_task(thread_args *thread, int task) {
+	task_queue *queue = thread->queue; 
+	task_args t = queue->tasks[task]; 
+	int k; 
+
+	if (t.w < 2*MIN_SPLIT_SIZE || t.h < 2*MIN_SPLIT_SIZE) {
+		return task; 
+	}
+	if (__atomic_load_n(&queue->pending, __ATOMIC_RELAXED) >= thread->num_threads) {
+		return task; 
+	}
+
+	int w1 = t.w/2/queue->step*queue->step, h1 = t.h/2/queue->step*queue->step; 
+	if (w1 == 0 || h1 == 0) {
+		return task; 
+	}
 
-	int iter = 0;
+	int first = __atomic_fetch_add(&queue->num_tasks, 4, __ATOMIC_RELAXED); 
+	if (first + 4 > queue->capacity) {
+		return task; 
+	}
+	for (k=0; k<4; k++) {
+		task_args *sub = &queue->tasks[first+k]; 
+		sub->x = t.x + (k%2 ? w1 : 0); 
+		sub->y = t.y + (k/2 ? h1 : 0); 
+		sub->w = k%2 ? t.w-w1 : w1; 
+		sub->h = k/2 ? t.h-h1 : h1; 
+	}
 
-	while( cabs(z)<4 && iter < max ) {
-		z = cpow(z,2) + alpha;
-		iter++;
+	__atomic_fetch_add(&queue->pending, 3, __ATOMIC_RELEASE); 
+	for (k=1; k<4; k++) {
+		deque_push(&queue->deques[thread->id], first+k); 
 	}
+	thread->stats.splits++; 
+
+	return first; 
+}
+
+/*
+Return the next task to run, counted as active, or -1 once every task
+has been claimed.  Subdivide mode and adaptive tiles make new tasks out
+of the ones being run, so there an idle thread keeps trying to steal
+until no task is active either.  A failed steal yields to the threads
+with work, and after STEAL_SPINS of them in a row sleeps briefly.
+*/
+static int next_task(thread_args *thread) {
+	task_queue *queue = thread->queue; 
+	struct timespec backoff = { 0, 50000 }; 
+	int wait_active = queue->subdivide || queue->adaptive; 
+	int failures = 0; 
+	int task; 
+
+	task = deque_pop(&queue->deques[thread->id]); 
+	if (task >= 0) {
+		__atomic_fetch_add(&queue->active, 1, __ATOMIC_RELAXED); 
+		__atomic_fetch_sub(&queue->pending, 1, __ATOMIC_RELAXED); 
+		if (queue->adaptive && thread->num_threads > 1) {
+			return split_task(thread, task); 
+		}
+		return task; 
+	}
+
+	while (thread->num_threads > 1 && (__atomic_load_n(&queue->pending, __ATOMIC_ACQUIRE) > 0 || (wait_active && __atomic_load_n(&queue->active, __ATOMIC_ACQUIRE) > 0))) {
+		if (__atomic_load_n(&frame_epoch, __ATOMIC_RELAXED) != thread->epoch) {
+			break; 
+		}
+
+		int victim = random_victim(thread); 
+		if (victim == thread->id) {
+			continue; 
+		}
+
+		task = deque_steal(&queue->deques[victim]); 
+		if (task >= 0) {
+			__atomic_fetch_add(&queue->active, 1, __ATOMIC_RELAXED); 
+			__atomic_fetch_sub(&queue->pending, 1, __ATOMIC_RELAXED); 
+			thread->stats.steals++; 
+			if (queue->subdivide) {
+				return task; 
+			}
+			return split_task(thread, task); 
+		}
+		thread->stats.failed_steals++; 
+		if (++failures < STEAL_SPINS) {
+			sched_yield(); 
+		} else {
+			nanosleep(&backoff, NULL); 
+		}
+	}
+
+	return -1; 
+}
+
+// Compute one tile task, one step x step block at a time
+static void compute_tile(thread_args *thread, int task) {
+	int i,j,k,bi,bj;  
+	int width = gfx_xsize(); 
+	int x_task, y_task, w_task, h_task; 
+	int step = thread->queue->step; 
+	int coarse = step < thread->queue->first_step ? 2*step : 0; 
 
-	return iter;
+	x_task = thread->queue->tasks[task].x; 
+	y_task = thread->queue->tasks[task].y; 
+	w_task = thread->queue->tasks[task].w; 
+	h_task = thread->queue->tasks[task].h; 
+
+	int px[w_task], py[w_task];
+	int cols[w_task];
+	int iters[w_task];
+
+	// Samples sit at multiples of step in the whole image, which a clipped task may not start on
+	for(j=(step-y_task%step)%step;j<h_task;j+=step) {
+
+		// Pick the pixels of this row that no coarser pass has computed
+		int n = 0; 
+		for(i=(step-x_task%step)%step;i<w_task;i+=step) {
+			if (coarse && (j+y_task)%coarse == 0 && (i+x_task)%coarse == 0) {
+				continue; 
+			}
+			px[n] = i+x_task; 
+			py[n] = j+y_task; 
+			cols[n] = i; 
+			n++; 
+		}
+
+		// Compute the iterations for the whole task row at once
+		frame_pixels(thread->frame,px,py,n,iters);
+
+		for(k=0;k<n;k++) {
+			int iter = iters[k];
+			unsigned int pixel = palette_color(&frame_palette, iter, frame_map.fracs[(j+y_task)*width+(cols[k]+x_task)]); 
+
+			// Store the point in the iteration map and the framebuffer, covering its whole block.
+			// Each task covers its own pixels, so no lock is needed.
+			thread->iter_map[(j+y_task)*width+(cols[k]+x_task)] = iter; 
+			for(bj=j;bj<j+step && bj<h_task;bj++) {
+				for(bi=cols[k];bi<cols[k]+step && bi<w_task;bi++) {
+					thread->pixels[(bj+y_task)*width+(bi+x_task)] = pixel;
+				}
+			}
+		}
+	}
+}
+
+// Compute the pixels x0..x1 of row y, storing them in the iteration map and framebuffer
+static void compute_span(thread_args *thread, int x0, int x1, int y) {
+	int n = x1-x0+1; 
+	int width = gfx_xsize(); 
+
+	if (n <= 0) {
+		return; 
+	}
+
+	int iters[n]; 
+	frame_row(thread->frame, x0, n, y, iters); 
+
+	memcpy(&thread->iter_map[y*width+x0], iters, n*sizeof(int)); 
+	palette_map(&frame_palette, iters, &frame_map.fracs[y*width+x0], &thread->pixels[y*width+x0], n); 
+}
+
+// Compute the pixels y0..y1 of column x
+static void compute_column(thread_args *thread, int x, int y0, int y1) {
+	int j, n = y1-y0+1; 
+	int width = gfx_xsize(); 
+
+	if (n <= 0) {
+		return; 
+	}
+
+	int xs[n], ys[n]; 
+	int iters[n]; 
+	for (j=0; j<n; j++) {
+		xs[j] = x; 
+		ys[j] = j+y0; 
+	}
+	frame_pixels(thread->frame, xs, ys, n, iters); 
+
+	for (j=0; j<n; j++) {
+		thread->iter_map[(j+y0)*width+x] = iters[j]; 
+		thread->pixels[(j+y0)*width+x] = palette_color(&frame_palette, iters[j], frame_map.fracs[(j+y0)*width+x]); 
+	}
+}
+
+// Return the iteration count shared by the whole border of x0..x1 by y0..y1, or -1
+static int border_count(thread_args *thread, int x0, int y0, int x1, int y1) {
+	int i, j; 
+	int width = gfx_xsize(); 
+	int *map = thread->iter_map; 
+	int iter = map[y0*width+x0]; 
+
+	for (i=x0; i<=x1; i++) {
+		if (map[y0*width+i] != iter || map[y1*width+i] != iter) {
+			return -1; 
+		}
+	}
+	for (j=y0+1; j<y1; j++) {
+		if (map[j*width+x0] != iter || map[j*width+x1] != iter) {
+			return -1; 
+		}
+	}
+	return iter; 
+}
+
+/*
+Run one task of subdivide mode on the rectangle x0..x1 by y0..y1, borders
+included.  Return 1 if the task has drawn its rectangle to the window
+itself, and 0 if it is left to be blitted.
+*/
+static int subdivide_task(thread_args *thread, int task) {
+	task_queue *queue = thread->queue; 
+	task_args t = queue->tasks[task]; 
+	int width = gfx_xsize(); 
+	int x0 = t.x, y0 = t.y, x1 = t.x+t.w-1, y1 = t.y+t.h-1; 
+	int i, j, k; 
+
+	if (!t.border_done) {
+		compute_span(thread, x0, x1, y0); 
+		if (y1 > y0) {
+			compute_span(thread, x0, x1, y1); 
+		}
+		compute_column(thread, x0, y0+1, y1-1); 
+		if (x1 > x0) {
+			compute_column(thread, x1, y0+1, y1-1); 
+		}
+	}
+	if (t.w <= 2 || t.h <= 2) {
+		return 0; 
+	}
+
+	// A uniform border means a uniform inside.  The fractions of the
+	// counts are not uniform, so smooth coloring only fills the interior.
+	int iter = border_count(thread, x0, y0, x1, y1); 
+	if (iter >= 0 && (iter == thread->maxiter || !frame_palette.smooth)) {
+		unsigned int color = palette_color(&frame_palette, iter, 0); 
+		for (j=y0+1; j<y1; j++) {
+			for (i=x0+1; i<x1; i++) {
+				thread->iter_map[j*width+i] = iter; 
+				frame_map.fracs[j*width+i] = 0; 
+				thread->pixels[j*width+i] = color; 
+			}
+		}
+		thread->stats.fills++; 
+
+		// The filled pixels have no orbits to carry on
+		__atomic_store_n(&frame_map.orbits, 0, __ATOMIC_RELAXED); 
+
+		// Show the border, unless the task that made this one shows it,
+		// and fill the inside with a single rectangle instead of its pixels
+		if (!t.border_done) {
+			show(x0, y0, t.w, 1, 0, 0, 0); 
+			show(x0, y1, t.w, 1, 0, 0, 0); 
+			show(x0, y0+1, 1, t.h-2, 0, 0, 0); 
+			show(x1, y0+1, 1, t.h-2, 0, 0, 0); 
+		}
+		show(x0+1, y0+1, t.w-2, t.h-2, 1, color, thread->epoch); 
+		return 1; 
+	}
+
+	// Small rectangles, or no room for more tasks: compute the inside directly
+	int first = -1; 
+	if (t.w >= 2*SUBDIVIDE_MIN_SIZE && t.h >= 2*SUBDIVIDE_MIN_SIZE) {
+		first = __atomic_fetch_add(&queue->num_tasks, 4, __ATOMIC_RELAXED); 
+	}
+	if (first < 0 || first + 4 > queue->capacity) {
+		for (j=y0+1; j<y1; j++) {
+			compute_span(thread, x0+1, x1-1, j); 
+		}
+		return 0; 
+	}
+
+	// Split along a middle row and column, which become borders of the quarters
+	int xm = (x0+x1)/2, ym = (y0+y1)/2; 
+	compute_span(thread, x0+1, x1-1, ym); 
+	compute_column(thread, xm, y0+1, ym-1); 
+	compute_column(thread, xm, ym+1, y1-1); 
+
+	for (k=0; k<4; k++) {
+		task_args *sub = &queue->tasks[first+k]; 
+		sub->x = k%2 ? xm : x0; 
+		sub->y = k/2 ? ym : y0; 
+		sub->w = (k%2 ? x1 : xm) - sub->x + 1; 
+		sub->h = (k/2 ? y1 : ym) - sub->y + 1; 
+		sub->border_done = 1; 
+	}
+
+	__atomic_fetch_add(&queue->pending, 4, __ATOMIC_RELEASE); 
+	for (k=0; k<4; k++) {
+		deque_push(&queue->deques[thread->id], first+k); 
+	}
+	thread->stats.splits++; 
+	return 0; 
 }
 
 /*
 Compute an entire image, writing each point to the given bitmap.
-Scale the image to the range (xmin-xmax,ymin-ymax).
+Scale the image to the range covered by the frame.
 */
 
 void *compute_image(void *args)
 {
 	thread_args *thread = (thread_args *) args;
-	int i,j;  
-	int width = gfx_xsize(); 
-	int height = gfx_ysize();
-	int x_size = width/20; 
-	int y_size = height/20; 
-	int x_task, y_task; 
+	int task; 
 
 	// For every pixel i,j, in the image...
 	while (1) {
 
-		// Lock critical section 
-		pthread_mutex_lock(&lock); 
-		x_task = -1; 
-		y_task = -1; 
-
-		// Find available tasks
-		for(i=0; i<y_size; i++) {
-			for(j=0; j<x_size; j++) {
-				if(thread->tasks[i][j].done==0) {
-					x_task = thread->tasks[i][j].x; 
-					y_task = thread->tasks[i][j].y;
-					thread->tasks[i][j].done = 1; 
-					break; 
-				} 
-			}
-
-			if (x_task >= 0 && y_task >= 0) {
-				break; 
-			}
+		// Stop if this frame was cancelled
+		if (__atomic_load_n(&frame_epoch, __ATOMIC_RELAXED) != thread->epoch) {
+			break; 
 		}
 
-		// Unlock critical section
-		pthread_mutex_unlock(&lock); 
+		// Claim the next available task
+		task = next_task(thread); 
 
 		// Break if all tasks finished 
-		if (x_task < 0 || y_task < 0) {
+		if (task < 0) {
 			break; 
 		}
 
-		for(j=0;j<20;j++) {
-			for(i=0;i<20;i++) {
+		double start = render_time(); 
+		task_args t = thread->queue->tasks[task]; 
+		int drawn = 0; 
+
+		if (thread->queue->subdivide) {
+			drawn = subdivide_task(thread, task); 
+		} else {
+			compute_tile(thread, task); 
+		}
 
-				// Scale from pixels i,j to coordinates x,y
-				double x = thread->xmin + (i+x_task)*(thread->xmax-thread->xmin)/width;
-				double y = thread->ymin + (j+y_task)*(thread->ymax-thread->ymin)/height;
+		__atomic_fetch_sub(&thread->queue->active, 1, __ATOMIC_RELEASE); 
+		thread->stats.busy += render_time() - start; 
+		thread->stats.tasks++; 
 
-				// Compute the iterations at x,y
-				int iter = compute_point(x,y,thread->maxiter);
+		// Queue the finished task to be shown with a single blit
+		if (!drawn) {
+			show(t.x, t.y, t.w, t.h, 0, 0, 0); 
+		}
+	}
 
-				// Convert a iteration number to an RGB color.
-				// (Change this bit to get more interesting colors.)
-				int color = (255 * iter / thread->maxiter)*10;
-				int color2 = (255 * iter / thread->maxiter)*20;
-				int color3 = (255 * iter / thread->maxiter)*50;
+	return NULL; 
+}
 
-				// Lock the critical section
-				pthread_mutex_lock(&lock); 
-				gfx_color(color,color2,color3);
+/*
+Make sure the queue has room for num_tiles tiles and their splits, and a
+deque for each of num_threads threads.  The memory is kept from frame to
+frame and only reallocated when it needs to grow.
+*/
+static void queue_reserve(task_queue *queue, int num_tiles, int num_threads) {
+	int i; 
 
-				// Plot the point on the screen.
-				gfx_point(i+x_task,j+y_task);
+	if (4*num_tiles > queue->capacity) {
+		free(queue->tasks); 
+		queue->capacity = 4*num_tiles; 
+		queue->tasks = (task_args *) calloc (queue->capacity, sizeof(task_args)); 
+		if (!queue->tasks) {
+			fprintf(stderr, "queue_reserve: out of memory.\n"); 
+			exit(1); 
+		}
 
-				// Unlock the critical section
-				pthread_mutex_unlock(&lock); 
-			}
+		// The deques are empty between frames, so they can be resized too
+		for (i=0; i<queue->num_deques; i++) {
+			deque_free(&queue->deques[i]); 
+			deque_init(&queue->deques[i], queue->capacity); 
 		}
 	}
 
-	pthread_exit(NULL); 
+	if (num_threads > queue->num_deques) {
+		queue->deques = (deque *) realloc (queue->deques, num_threads*sizeof(deque)); 
+		if (!queue->deques) {
+			fprintf(stderr, "queue_reserve: out of memory.\n"); 
+			exit(1); 
+		}
+		for (i=queue->num_deques; i<num_threads; i++) {
+			deque_init(&queue->deques[i], queue->capacity); 
+		}
+		queue->num_deques = num_threads; 
+	}
 }
 
-void create_threads(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	int i, j, rc;
-	int height = gfx_ysize(); 
-	int width = gfx_xsize();
-	int x_size = width/20, y_size = height/20;  
-	pthread_t p[num_threads];  
-	thread_args args[num_threads];
-	
-	// Allocate memory for tasks array
-	tasks = (task_args **) calloc (height, sizeof(task_args *));
-	for(i=0; i<height; i++) {
-		tasks[i] = (task_args *) calloc (width, sizeof(task_args)); 
-	}
-
-	// Initialize tasks
+// Cancel the frame in flight, if any, and wait for its workers to stop.  Returns whether one was running
+int cancel_frame() {
+	int running = frame_running; 
+
+	__atomic_add_fetch(&frame_epoch, 1, __ATOMIC_RELAXED); 
+	pool_wait(workers); 
+	frame_running = 0; 
+	return running; 
+}
+
+// The side of the cells of the frame.  Subdivide mode starts from larger rectangles, to have room to subdivide them
+static int frame_tile_size() {
+	int size = tile_size ? tile_size : TILE_SIZE; 
+	return queue.subdivide ? SUBDIVIDE_TILES*size : size; 
+}
+
+// The number of cells across and down the frame, counting the clipped ones at the edges
+static int frame_cells(int *x_size, int *y_size) {
+	int size = frame_tile_size(); 
+	*x_size = (gfx_xsize()+size-1)/size; 
+	*y_size = (gfx_ysize()+size-1)/size; 
+	return *x_size * *y_size; 
+}
+
+// Clip the cell in row i and column j to the edges of the frame
+static void cell_rect(int i, int j, int *x0, int *y0, int *w, int *h) {
+	int size = frame_tile_size(); 
+	*x0 = j*size; 
+	*y0 = i*size; 
+	*w = *x0+size < gfx_xsize() ? size : gfx_xsize()-*x0; 
+	*h = *y0+size < gfx_ysize() ? size : gfx_ysize()-*y0; 
+}
+
+/*
+Look up the cells of the frame that must be computed in the tile
+cache, and draw the ones found there, marking them in tile_hits so no
+pass computes them.  Tiles are cached by their counts, so a hit is
+colored here.
+*/
+static void serve_cached_tiles(const viewport *view, unsigned int *pixels) {
+	int i, j, bj; 
+	int width = gfx_xsize(), height = gfx_ysize(); 
+	int x_size, y_size; 
+	int cells = frame_cells(&x_size, &y_size); 
+	tile_key key; 
+
+	if (cells > tile_hits_size) {
+		free(tile_hits); 
+		tile_hits_size = cells; 
+		tile_hits = (char *) malloc (tile_hits_size); 
+		if (!tile_hits) {
+			fprintf(stderr, "serve_cached_tiles: out of memory.\n"); 
+			exit(1); 
+		}
+	}
+	memset(tile_hits, 0, cells); 
+	if (!tile_cache.budget) {
+		return; 
+	}
+
 	for (i=0; i<y_size; i++) {
 		for (j=0; j<x_size; j++) {
-			tasks[i][j].x = j*20; 
-			tasks[i][j].y = i*20; 
-			tasks[i][j].done = 0; 
+			int x0, y0, w, h; 
+			cell_rect(i, j, &x0, &y0, &w, &h); 
+			if (x0 < frame_x || y0 < frame_y || x0+w > frame_x+frame_w || y0+h > frame_y+frame_h) {
+				continue; 
+			}
+			tilecache_key(&key, view, width, height, x0, y0, w, h, queue.subdivide); 
+			const float *fracs; 
+			const int *iters = tilecache_find(&tile_cache, &key, &fracs); 
+			if (!iters) {
+				continue; 
+			}
+			for (bj=0; bj<h; bj++) {
+				memcpy(&frame_map.iters[(y0+bj)*width+x0], &iters[bj*w], w*sizeof(int)); 
+				memcpy(&frame_map.fracs[(y0+bj)*width+x0], &fracs[bj*w], w*sizeof(float)); 
+				palette_map(&frame_palette, &iters[bj*w], &fracs[bj*w], &pixels[(y0+bj)*width+x0], w); 
+			}
+			tile_hits[i*x_size+j] = 1; 
+			frame_map.orbits = 0; 
+			gfx_blit(x0, y0, w, h); 
 		}
 	}
+}
 
+// Store the cells of a finished frame that did not come from the cache
+static void cache_frame_tiles() {
+	int i, j; 
+	int width = gfx_xsize(); 
+	int x_size, y_size; 
+	tile_key key; 
 
-	for (i = 0; i < num_threads; i++) {
-		args[i].xmin = xmin;
-		args[i].xmax = xmax;
-		args[i].ymin = ymin;
-		args[i].ymax = ymax;
-		args[i].maxiter = maxiter;
-		args[i].num_threads = num_threads;
-		args[i].tasks = tasks; 
-		rc = pthread_create(&p[i], NULL, compute_image, &args[i]); 
-		if (rc < 0) {
-			exit(1); 
+	if (!tile_cache.budget) {
+		return; 
+	}
+	frame_cells(&x_size, &y_size); 
+	for (i=0; i<y_size; i++) {
+		for (j=0; j<x_size; j++) {
+			int x0, y0, w, h; 
+			if (tile_hits[i*x_size+j]) {
+				continue; 
+			}
+			cell_rect(i, j, &x0, &y0, &w, &h); 
+			tilecache_key(&key, &frame_map.view, width, gfx_ysize(), x0, y0, w, h, queue.subdivide); 
+			tilecache_insert(&tile_cache, &key, &frame_map.iters[y0*width+x0], &frame_map.fracs[y0*width+x0], width); 
 		}
 	}
+}
 
-	for (i=0; i < num_threads; i++) {
-		pthread_join(p[i], NULL); 
+// Add a task for the pixels to compute of the rectangle x0..x1 by y0..y1, ends excluded, to a thread's deque
+static int add_task(int n, int x0, int y0, int x1, int y1, int thread) {
+	if (x0 < frame_x) x0 = frame_x; 
+	if (y0 < frame_y) y0 = frame_y; 
+	if (x1 > frame_x+frame_w) x1 = frame_x+frame_w; 
+	if (y1 > frame_y+frame_h) y1 = frame_y+frame_h; 
+	if (x0 >= x1 || y0 >= y1) {
+		return n; 
 	}
 
-	// Free tasks
-	for(i=0; i<height; i++) {
-		free(tasks[i]); 
+	task_args *t = &queue.tasks[n]; 
+	t->x = x0; 
+	t->y = y0; 
+	t->w = x1-x0; 
+	t->h = y1-y0; 
+	t->border_done = 0; 
+	deque_push(&queue.deques[thread%frame_num_threads], n); 
+	return n+1; 
+}
+
+// With adaptive tiles, the side in cells of the square blocks that give about ADAPTIVE_TASKS per thread
+static int block_cells(int x_size, int y_size) {
+	int i, j, x0, y0, w, h, cells = 0; 
+
+	if (!queue.adaptive) {
+		return 1; 
 	}
-	free(tasks); 
+	for (i=0; i<y_size; i++) {
+		for (j=0; j<x_size; j++) {
+			cell_rect(i, j, &x0, &y0, &w, &h); 
+			if (x0 < frame_x+frame_w && x0+w > frame_x && y0 < frame_y+frame_h && y0+h > frame_y && !tile_hits[i*x_size+j]) {
+				cells++; 
+			}
+		}
+	}
+
+	int block = (int) sqrt((double) cells / (ADAPTIVE_TASKS*frame_num_threads)); 
+	return block > 1 ? block : 1; 
 }
 
-// Move up function
-void move_up(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double yrange = ymax-ymin; 
-	ymin -= yrange/4;
-	ymax -= yrange/4;  	
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+// Deal out the tiles for one pass of the frame and start the workers on it
+void start_pass(int step) {
+	int i, j, bi, bj, n = 0;
+
+	int size = frame_tile_size(); 
+	int x_size, y_size; 
+	int cells = frame_cells(&x_size, &y_size); 
+	int block = block_cells(x_size, y_size); 
+
+	// One task per cell, with room for the cells to be split, or in
+	// subdivide mode for three levels of quarters of each cell.
+	// A cancelled frame may have left tasks behind in the deques.
+	queue_reserve(&queue, cells*(queue.subdivide ? 22 : 1), frame_num_threads); 
+	queue.step = step; 
+	for (i=0; i<queue.num_deques; i++) {
+		deque_clear(&queue.deques[i]); 
+	}
+
+	// Initialize tasks for the blocks of cells that overlap the pixels to
+	// compute, dealing them out along diagonals so every thread starts
+	// with tiles from all over the image.  A block with cached cells is
+	// cut back into the cells that are not.
+	for (i=0; i<y_size; i+=block) {
+		for (j=0; j<x_size; j+=block) {
+			int rows = i+block < y_size ? block : y_size-i; 
+			int cols = j+block < x_size ? block : x_size-j; 
+			int hits = 0; 
+			for (bi=i; bi<i+rows; bi++) {
+				for (bj=j; bj<j+cols; bj++) {
+					hits += tile_hits[bi*x_size+bj]; 
+				}
+			}
+			if (!hits) {
+				n = add_task(n, j*size, i*size, (j+cols)*size, (i+rows)*size, (i+j)/block); 
+				continue; 
+			}
+			for (bi=i; bi<i+rows; bi++) {
+				for (bj=j; bj<j+cols; bj++) {
+					if (!tile_hits[bi*x_size+bj]) {
+						n = add_task(n, bj*size, bi*size, (bj+1)*size, (bi+1)*size, bi+bj); 
+					}
+				}
+			}
+		}
+	}
+	queue.num_tasks = n; 
+	queue.pending = n; 
+	queue.active = 0; 
+
+	pool_submit(workers, frame_num_threads, compute_image, frame_args, sizeof(thread_args)); 
 }
 
-// Move down function
-void move_down(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double yrange = ymax-ymin; 
-	ymin += yrange/4; 
-	ymax += yrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+// Start drawing a frame in the background, cancelling the one in flight
+void create_threads(const viewport *view, int num_threads) {
+	int i;
+	int maxiter = view->maxiter; 
+
+	cancel_frame(); 
+
+	thread_args *args = (thread_args *) realloc (frame_args, num_threads*sizeof(thread_args)); 
+	if (!args) {
+		fprintf(stderr, "create_threads: out of memory.\n"); 
+		exit(1); 
+	}
+	frame_args = args; 
+	frame_num_threads = num_threads; 
+
+	unsigned int *pixels = gfx_framebuffer();
+
+	// Only compute the pixels that the last frame cannot provide
+	itermap_begin(&frame_map, pixels, gfx_xsize(), gfx_ysize(), view, &frame_x, &frame_y, &frame_w, &frame_h); 
+	frame_begin(&frame_state, view, &frame_map); 
+	palette_build(&frame_palette, maxiter); 
+	if (frame_w < gfx_xsize() || frame_h < gfx_ysize()) {
+		gfx_blit(0, 0, gfx_xsize(), gfx_ysize()); 
+	}
+
+	// Subdivide mode fills whole rectangles, so it is never progressive
+	queue.subdivide = subdivide; 
+	queue.adaptive = !tile_size && !subdivide; 
+	queue.first_step = progressive && !subdivide ? PROGRESSIVE_STEP : 1; 
+
+	for (i = 0; i < num_threads; i++) {
+		args[i].frame = &frame_state;
+		args[i].maxiter = maxiter;
+		args[i].num_threads = num_threads;
+		args[i].id = i; 
+		args[i].epoch = frame_epoch; 
+		args[i].seed = 2654435761u*(i+1); 
+		args[i].queue = &queue; 
+		args[i].pixels = pixels; 
+		args[i].iter_map = frame_map.iters; 
+		memset(&args[i].stats, 0, sizeof(thread_stats)); 
+	}
+
+	// Run the frame on the worker pool, apart from the tiles already cached
+	frame_start = render_time(); 
+	serve_cached_tiles(view, pixels); 
+	start_pass(queue.first_step); 
+	frame_running = 1; 
 }
 
-// Move left function
-void move_left(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double xrange = xmax-xmin; 
-	xmin -= xrange/4; 
-	xmax -= xrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+// Report how evenly the work of a finished frame was spread
+void report_frame() {
+	int i; 
+	double elapsed = render_time() - frame_start; 
+	thread_args *args = frame_args; 
+
+	printf("frame: %.3fs\n", elapsed); 
+	for (i=0; i < frame_num_threads; i++) {
+		printf("thread %d: busy %.3fs (%.0f%%), %d tasks, %d steals, %d failed steals, %d splits, %d fills\n", i, args[i].stats.busy, 100*args[i].stats.busy/elapsed, args[i].stats.tasks, args[i].stats.steals, args[i].stats.failed_steals, args[i].stats.splits, args[i].stats.fills); 
+	}
+	printf("cache: %ld hits, %ld misses, %d tiles, %.1f of %.1f MB\n", tile_cache.hits, tile_cache.misses, tile_cache.count, tile_cache.bytes/1e6, tile_cache.budget/1e6); 
 }
 
-// Move right function
-void move_right(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double xrange = xmax-xmin; 
-	xmin += xrange/4; 
-	xmax += xrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+/*
+Color the whole last frame from its iteration map on the worker pool,
+equalizing the palette for it first if that is on.  Each step of the
+pass runs on one band of the frame per thread, with a wait after it.
+*/
+void color_frame(int num_threads) {
+	int width = gfx_xsize(); 
+	int height = gfx_ysize(); 
+
+	unsigned int *pixels = gfx_framebuffer();
+
+	palette_pass_begin(&color_pass, &frame_palette, frame_map.iters, frame_map.fracs, pixels, width*height, frame_map.view.maxiter, num_threads); 
+	if (frame_palette.equalize) {
+		pool_submit(workers, num_threads, palette_count_band, color_pass.bands, sizeof(palette_band)); 
+		pool_wait(workers); 
+		pool_submit(workers, num_threads, palette_merge_band, color_pass.bands, sizeof(palette_band)); 
+		pool_wait(workers); 
+		palette_equalize(&color_pass); 
+	}
+	pool_submit(workers, num_threads, palette_map_band, color_pass.bands, sizeof(palette_band)); 
+	pool_wait(workers); 
+
+	gfx_blit(0, 0, width, height); 
 }
 
-// Zoom in function
-void zoom_in(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin; 
-	xmin -= xrange/4; 
-	xmax -= xrange/4; 
-	ymin -= yrange/4; 
-	ymax -= yrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+/*
+After the palette has changed, color the whole last frame again, with
+no iterations to compute.  A frame that was still being drawn, which
+the caller cancelled before changing the palette the workers color
+with, is started again instead.
+*/
+void recolor_image(const viewport *view, int num_threads, int restart) {
+	palette_print(&frame_palette); 
+	if (restart) {
+		create_threads(view, num_threads); 
+	} else {
+		color_frame(num_threads); 
+	}
 }
 
-// Zoom out function
-void zoom_out(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin; 
-	xmin += xrange/4; 
-	xmax += xrange/4; 
-	ymin += yrange/4; 
-	ymax += yrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+// Check for a key or mouse click without blocking
+int next_event(int *c) {
+	int event; 
+
+	event = gfx_event_waiting(); 
+	if (event) {
+		*c = gfx_wait(); 
+	}
+
+	return event; 
 }
 
-// Recenter function
-void recenter(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	int width = gfx_xsize();
-	int height = gfx_ysize(); 
-	int xpos = gfx_xpos(); 
-	int ypos = gfx_ypos(); 
+// The workers have finished a pass: start the next one, or note that the frame is done
+void end_pass() {
+	present(); 
+	if (queue.step > 1) {
+		start_pass(queue.step/2); 
+		return; 
+	}
+	frame_running = 0; 
+	cache_frame_tiles(); 
+	itermap_end(&frame_map); 
 
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin;
+	// Equalizing needs the counts of the whole frame
+	if (frame_palette.equalize) {
+		color_frame(frame_num_threads); 
+	}
+	if (show_stats) {
+		report_frame(); 
+	}
+}
 
-	double xcenter = xmin + xrange * xpos / width; 
-	double ycenter = ymin + yrange * ypos / height;  
+// With no event to handle, show what is done, move on when a pass is done and rest briefly
+void idle() {
+	struct timespec delay = { 0, 2000000 }; 
 
-	xmax = xcenter + xrange; 
-	xmin = xcenter - xrange; 
-	ymax = ycenter + yrange; 
-	ymin = ycenter - yrange; 
+	if (frame_running && pool_finished(workers)) {
+		end_pass(); 
+		if (frame_running) return; 
+	} else if (render_time() - last_present >= PRESENT_INTERVAL) {
+		present(); 
+	}
 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
- 
-	return; 
+	nanosleep(&delay, NULL); 
 }
 
-// Change maxiter
-void change_maxiter(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	maxiter *= 5; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+// Block until every pass of the frame in flight is drawn
+void finish_frame() {
+	while (frame_running) {
+		pool_wait(workers); 
+		end_pass(); 
+	}
 }
 
 int main( int argc, char *argv[] )
@@ -287,83 +936,126 @@ int main( int argc, char *argv[] )
 	double xmax= 0.5;
 	double ymin=-1.0;
 	double ymax= 1.0;
-	int num_threads = 1; 
 
 	// Maximum number of iterations to compute.
 	// Higher values take longer but have more detail.
 	int maxiter=500;
 
-	// Open a new window.
-	gfx_open(640,480,"Mandelbrot Fractal");
+	// Let the command line change the view, the window size and the thread count
+	render_options opts = { 0, 640, 480, {0}, pool_nproc(), 0, 0, CACHE_MB }; 
+	view_init(&opts.view,xmin,xmax,ymin,ymax,maxiter);
+	render_parse(argc, argv, &opts); 
+	int num_threads = opts.threads; 
+	tile_size = opts.tile_size; 
+	subdivide = opts.subdivide; 
+	tilecache_init(&tile_cache, (size_t) opts.cache_mb << 20); 
+
+	// The view that the navigation commands move around
+	viewport view = opts.view; 
+
+	// Start with the colors this program has always had
+	palette_init(&frame_palette, 2); 
+
+	// Start the worker threads once, to be reused for every frame
+	workers = pool_create(num_threads); 
+	rectqueue_init(&shown, PRESENT_QUEUE); 
 
 	// Show the configuration, just in case you want to recreate it.
-	printf("coordinates: %lf %lf %lf %lf\n",xmin,xmax,ymin,ymax);
+	view_print(&view);
+
+	// With an output file, draw one frame in memory and write it out
+	if (opts.output) {
+		gfx_open_headless(opts.width, opts.height); 
+		double start = render_time(); 
+		create_threads(&view, num_threads); 
+		finish_frame(); 
+		render_report(frame_map.iters, opts.width, opts.height, render_time()-start); 
+		int status = render_write(opts.output, gfx_framebuffer(), opts.width, opts.height); 
+		pool_destroy(workers); 
+		exit(status ? 1 : 0); 
+	}
+
+	// Open a new window.
+	gfx_open(opts.width,opts.height,"Mandelbrot Fractal");
 
 	// Fill it with a dark blue initially.
 	gfx_clear_color(0,0,255);
 	gfx_clear();
 
 	// Display the fractal image
-	create_threads(xmin,xmax,ymin,ymax,maxiter,num_threads);
-	gfx_flush();
+	create_threads(&view,num_threads);
 	int c = 0;
+	int running;
 	while(1) {
-		// Wait for a key or mouse click.
-		if (gfx_event_waiting()) {
-		c = gfx_wait();
+		// Wait for a key or mouse click, while the frame is drawn.
+		if (next_event(&c)) {
 
 		switch (c) {
 			case ('r'):
 				// Move right
-				move_right(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_move(&view, 0.25, 0); 
+				create_threads(&view, num_threads); 
 				break;  
 			case ('l'):
 				// Move left
-				move_left(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_move(&view, -0.25, 0); 
+				create_threads(&view, num_threads); 
 				break;
 			case ('u'):
 				// Move up
-				move_up(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_move(&view, 0, -0.25); 
+				create_threads(&view, num_threads); 
 				break;  
 			case ('d'):
 				// Move down
-				move_down(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_move(&view, 0, 0.25); 
+				create_threads(&view, num_threads); 
 				break; 
 			case ('q'):
 				// Quit if q is pressed
-				pthread_mutex_destroy(&lock); 
+				cancel_frame(); 
+				pool_destroy(workers); 
+				rectqueue_free(&shown); 
 				exit(0); 
 			case ('i'): 
 				// Zoom in
-				zoom_in(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_zoom(&view, 0.5); 
+				create_threads(&view, num_threads); 
 				break;
 			case ('+'):
 				// Zoom in
-				zoom_in(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_zoom(&view, 0.5); 
+				create_threads(&view, num_threads); 
 				break; 
 			case ('o'):
 				// Zoom out
-				zoom_out(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_zoom(&view, 2); 
+				create_threads(&view, num_threads); 
 				break;
 			case ('-'):
 				// Zoom out
-				zoom_out(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_zoom(&view, 2); 
+				create_threads(&view, num_threads); 
 				break;
 			case (1):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				create_threads(&view, num_threads); 
 				break;  
 			case (2):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				create_threads(&view, num_threads); 
 				break; 
 			case (3):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				create_threads(&view, num_threads); 
 				break; 
 			case ('m'):
 				// Change maxiter
-				change_maxiter(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_change_maxiter(&view, 5); 
+				create_threads(&view, num_threads); 
 				break; 
 			case ('1'):
 				// Run with 1 thread
@@ -397,10 +1089,50 @@ int main( int argc, char *argv[] )
 				// Run with 8 threads
 				num_threads = 8;   
 				break; 
+			case ('p'):
+				// Toggle progressive drawing, coarse blocks first
+				progressive = !progressive; 
+				create_threads(&view, num_threads); 
+				break; 
+			case ('b'):
+				// Toggle subdivide mode, filling rectangles with a uniform border
+				subdivide = !subdivide; 
+				create_threads(&view, num_threads); 
+				break; 
+			case ('s'):
+				// Toggle the per-thread statistics
+				show_stats = !show_stats; 
+				break; 
+			case ('c'):
+				// Next palette
+				running = cancel_frame(); 
+				palette_next_scheme(&frame_palette); 
+				recolor_image(&view, num_threads, running); 
+				break; 
+			case ('x'):
+				// Next color scale
+				running = cancel_frame(); 
+				palette_next_scale(&frame_palette); 
+				recolor_image(&view, num_threads, running); 
+				break; 
+			case ('n'):
+				// Toggle smooth coloring
+				running = cancel_frame(); 
+				palette_toggle_smooth(&frame_palette); 
+				recolor_image(&view, num_threads, running); 
+				break; 
+			case ('e'):
+				// Toggle histogram equalization
+				running = cancel_frame(); 
+				palette_toggle_equalize(&frame_palette); 
+				recolor_image(&view, num_threads, running); 
+				break; 
 			default:
 				break; 
 		}
-		} 
+		} else {
+			idle(); 
+		}
 	}
 	return 0;
 }
@@ -3,220 +3,270 @@ fractal.c - Sample Mandelbrot Fractal Display
 Starting code for CSE 30341 Project 3.
 */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "gfx.h"
+#include "view.h"
+#include "pool.h"
+#include "itermap.h"
+#include "frame.h"
+#include "palette.h"
+#include "rectqueue.h"
+#include "render.h"
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <errno.h>
 #include <string.h>
-#include <complex.h>
 #include <pthread.h>
+#include <time.h>
 
-/*
-Compute the number of iterations at point x, y
-in the complex space, up to a maximum of maxiter.
-Return the number of iterations at that point.
-
-This example computes the Mandelbrot fractal:
-z = z^2 + alpha
-
-Where z is initially zero, and alpha is the location x + iy
-in the complex plane.  Note that we are using the "complex"
-numeric type in C, which has the special functions cabs()
-and cpow() to compute the absolute values and powers of
-complex values.
-*/
+#define PRESENT_INTERVAL (1.0/60)
+#define PRESENT_QUEUE 16384
 
 typedef struct {
-	double xmin; 
-	double xmax; 
-	double ymin; 
-	double ymax;
+	const frame *frame; 
 	int start; 
 	int end;  
+	int left; 
+	int right; 
 	int maxiter; 
 	int num_threads; 
+	int epoch; 
+	unsigned int *pixels; 
+	int *iter_map; 
 } thread_args; 
 
-pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER; 
-
-static int compute_point( double x, double y, int max )
-{
-	double complex z = 0;
-	double complex alpha = x + I*y;
+/*
+Frames are drawn in the background while main keeps handling events.
+Starting a frame bumps frame_epoch, and a worker whose epoch no longer
+matches stops at the next row, so a new keypress cancels the frame in
+flight.
+
+main is also the only thread that touches the display.  Workers push
+the rows they finish onto the shown queue, and main draws whatever has
+been queued in one batch, with one flush, PRESENT_INTERVAL after the
+last batch, so a worker never waits on the X connection.  A worker that
+finds the queue full sets present_all instead, to draw the whole frame.
+*/
+pool *workers; 
+thread_args *frame_args; 
+int frame_num_threads = 0; 
+int frame_epoch = 0; 
+int frame_running = 0; 
+itermap frame_map; 
+frame frame_state; 
+palette frame_palette; 
+palette_pass color_pass; 
+rectqueue shown; 
+int present_all = 0; 
+double last_present = 0; 
+
+// Queue a finished rectangle of the framebuffer to be shown
+static void show(int x, int y, int w, int h) {
+	rect r = { x, y, w, h, 0, 0, 0 }; 
+
+	if (!rectqueue_push(&shown, &r)) {
+		__atomic_store_n(&present_all, 1, __ATOMIC_RELEASE); 
+	}
+}
 
-	int iter = 0;
+// Draw every rectangle queued so far, and flush them to the display
+void present() {
+	rect r; 
 
-	while( cabs(z)<4 && iter < max ) {
-		z = cpow(z,2) + alpha;
-		iter++;
+	while (rectqueue_pop(&shown, &r)) {
+		gfx_blit(r.x, r.y, r.w, r.h); 
 	}
-
-	return iter;
+	if (__atomic_exchange_n(&present_all, 0, __ATOMIC_ACQUIRE)) {
+		gfx_blit(0, 0, gfx_xsize(), gfx_ysize()); 
+	}
+	gfx_flush(); 
+	last_present = render_time(); 
 }
 
 /*
 Compute an entire image, writing each point to the given bitmap.
-Scale the image to the range (xmin-xmax,ymin-ymax).
+Scale the image to the range covered by the frame.
 */
 
 void *compute_image(void *args)
 {
 	thread_args *thread = (thread_args *) args; 
-	int i,j;  
+	int j;  
 	int width = gfx_xsize(); 
-	int height = gfx_ysize();  
+	int iters[width];
 
 	// For every pixel i,j, in the image...
 
 	for(j=thread->start;j<thread->end;j++) {
-		for(i=0;i<width;i++) {
 
-			// Scale from pixels i,j to coordinates x,y
-			double x = thread->xmin + i*(thread->xmax-thread->xmin)/width;
-			double y = thread->ymin + j*(thread->ymax-thread->ymin)/height;
+		// Stop if this frame was cancelled
+		if (__atomic_load_n(&frame_epoch, __ATOMIC_RELAXED) != thread->epoch) {
+			break; 
+		}
 
-			// Compute the iterations at x,y
-			int iter = compute_point(x,y,thread->maxiter);
+		// Compute the iterations for the whole row at once
+		frame_row(thread->frame,thread->left,thread->right-thread->left,j,&iters[thread->left]);
 
-			// Convert a iteration number to an RGB color.
-			// (Change this bit to get more interesting colors.)
-			int color = (255 * iter / thread->maxiter)*5; 
-			int color2 = (255 * iter / thread->maxiter)*10; 
-			int color3 = (255 * iter / thread->maxiter)*15; 
+		// Store the row in the iteration map, and color it into the framebuffer.
+		// Each thread owns its own rows, so no lock is needed.
+		memcpy(&thread->iter_map[j*width+thread->left], &iters[thread->left], (thread->right-thread->left)*sizeof(int)); 
+		palette_map(&frame_palette, &iters[thread->left], &frame_map.fracs[j*width+thread->left], &thread->pixels[j*width+thread->left], thread->right-thread->left); 
 
-			// Lock the critical section
-			pthread_mutex_lock(&lock); 
-			gfx_color(color,color2,color3);
+		// Queue the finished row to be shown
+		show(thread->left, j, thread->right-thread->left, 1); 
+	}
+	return NULL; 
+}
 
-			// Plot the point on the screen.
-			gfx_point(i,j);
+// Cancel the frame in flight, if any, and wait for its workers to stop.  Returns whether one was running
+int cancel_frame() {
+	int running = frame_running; 
 
-			// Unlock the critical section
-			pthread_mutex_unlock(&lock); 
-		}
-	}
-	pthread_exit(NULL); 
+	__atomic_add_fetch(&frame_epoch, 1, __ATOMIC_RELAXED); 
+	pool_wait(workers); 
+	frame_running = 0; 
+	return running; 
 }
 
-void create_threads(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	int i, rc;
+// Start drawing a frame in the background, cancelling the one in flight
+void create_threads(const viewport *view, int num_threads) {
+	int i;
+	int maxiter = view->maxiter; 
+	int width = gfx_xsize(); 
 	int height = gfx_ysize(); 
-	pthread_t p[num_threads];  
 	int start, end;  
-	thread_args args[num_threads];
+	int x, y, w, h; 
+
+	cancel_frame(); 
+
+	thread_args *args = (thread_args *) realloc (frame_args, num_threads*sizeof(thread_args)); 
+	if (!args) {
+		fprintf(stderr, "create_threads: out of memory.\n"); 
+		exit(1); 
+	}
+	frame_args = args; 
+	frame_num_threads = num_threads; 
+
+	unsigned int *pixels = gfx_framebuffer();
+
+	// Only compute the pixels that the last frame cannot provide
+	itermap_begin(&frame_map, pixels, width, height, view, &x, &y, &w, &h); 
+	frame_begin(&frame_state, view, &frame_map); 
+	palette_build(&frame_palette, maxiter); 
+	if (w < width || h < height) {
+		gfx_blit(0, 0, width, height); 
+	}
 
 	for (i = 0; i < num_threads; i++) {
-		start = (i)*(height/num_threads); 
-		end = (i+1)*(height/num_threads); 
-		args[i].xmin = xmin;
-		args[i].xmax = xmax;
-		args[i].ymin = ymin;
-		args[i].ymax = ymax;
+		start = y + (i)*(h/num_threads); 
+		end = y + (i+1)*(h/num_threads); 
+		if (i == num_threads-1) {
+			// The last thread also takes the rows left over by the division
+			end = y + h; 
+		}
+		args[i].frame = &frame_state;
 		args[i].start = start;
 		args[i].end = end;
+		args[i].left = x; 
+		args[i].right = x + w; 
 		args[i].maxiter = maxiter;
 		args[i].num_threads = num_threads;	
-		rc = pthread_create(&p[i], NULL, compute_image, (void *) &args[i]); 
-		if (rc < 0) {
-			exit(1); 
-		}
+		args[i].epoch = frame_epoch; 
+		args[i].pixels = pixels;
+		args[i].iter_map = frame_map.iters; 
 	}
 
-	for (i=0; i < num_threads; i++) {
-		pthread_join(p[i], NULL); 
-	}
+	// Run the frame on the worker pool
+	pool_submit(workers, num_threads, compute_image, args, sizeof(thread_args)); 
+	frame_running = 1; 
 }
 
-// Move up function
-void move_up(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double yrange = ymax-ymin; 
-	ymin -= yrange/4;
-	ymax -= yrange/4;  	
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
-}
+/*
+Color the whole last frame from its iteration map on the worker pool,
+equalizing the palette for it first if that is on.  Each step of the
+pass runs on one band of the frame per thread, with a wait after it.
+*/
+void color_frame(int num_threads) {
+	int width = gfx_xsize(); 
+	int height = gfx_ysize(); 
 
-// Move down function
-void move_down(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double yrange = ymax-ymin; 
-	ymin += yrange/4; 
-	ymax += yrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
-}
+	unsigned int *pixels = gfx_framebuffer();
 
-// Move left function
-void move_left(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double xrange = xmax-xmin; 
-	xmin -= xrange/4; 
-	xmax -= xrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
-}
+	palette_pass_begin(&color_pass, &frame_palette, frame_map.iters, frame_map.fracs, pixels, width*height, frame_map.view.maxiter, num_threads); 
+	if (frame_palette.equalize) {
+		pool_submit(workers, num_threads, palette_count_band, color_pass.bands, sizeof(palette_band)); 
+		pool_wait(workers); 
+		pool_submit(workers, num_threads, palette_merge_band, color_pass.bands, sizeof(palette_band)); 
+		pool_wait(workers); 
+		palette_equalize(&color_pass); 
+	}
+	pool_submit(workers, num_threads, palette_map_band, color_pass.bands, sizeof(palette_band)); 
+	pool_wait(workers); 
 
-// Move right function
-void move_right(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double xrange = xmax-xmin; 
-	xmin += xrange/4; 
-	xmax += xrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+	gfx_blit(0, 0, width, height); 
 }
 
-// Zoom in function
-void zoom_in(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin; 
-	xmin -= xrange/4; 
-	xmax -= xrange/4; 
-	ymin -= yrange/4; 
-	ymax -= yrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+/*
+After the palette has changed, color the whole last frame again, with
+no iterations to compute.  A frame that was still being drawn, which
+the caller cancelled before changing the palette the workers color
+with, is started again instead.
+*/
+void recolor_image(const viewport *view, int num_threads, int restart) {
+	palette_print(&frame_palette); 
+	if (restart) {
+		create_threads(view, num_threads); 
+	} else {
+		color_frame(num_threads); 
+	}
 }
 
-// Zoom out function
-void zoom_out(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin; 
-	xmin += xrange/4; 
-	xmax += xrange/4; 
-	ymin += yrange/4; 
-	ymax += yrange/4; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+// Check for a key or mouse click without blocking
+int next_event(int *c) {
+	int event; 
+
+	event = gfx_event_waiting(); 
+	if (event) {
+		*c = gfx_wait(); 
+	}
+
+	return event; 
 }
 
-// Recenter function
-void recenter(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	int width = gfx_xsize();
-	int height = gfx_ysize(); 
-	int xpos = gfx_xpos(); 
-	int ypos = gfx_ypos(); 
+// Note that the workers have drawn the whole frame
+void end_frame() {
+	frame_running = 0; 
+	itermap_end(&frame_map); 
+	present(); 
 
-	double xrange = xmax-xmin; 
-	double yrange = ymax-ymin;
+	// Equalizing needs the counts of the whole frame
+	if (frame_palette.equalize) {
+		color_frame(frame_num_threads); 
+	}
+}
 
-	double xcenter = xmin + xrange * xpos / width; 
-	double ycenter = ymin + yrange * ypos / height;  
+// With no event to handle, show what is done, note when the frame is done and rest briefly
+void idle() {
+	struct timespec delay = { 0, 2000000 }; 
 
-	xmax = xcenter + xrange; 
-	xmin = xcenter - xrange; 
-	ymax = ycenter + yrange; 
-	ymin = ycenter - yrange; 
+	if (frame_running && pool_finished(workers)) {
+		end_frame(); 
+	} else if (render_time() - last_present >= PRESENT_INTERVAL) {
+		present(); 
+	}
 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
- 
-	return; 
+	nanosleep(&delay, NULL); 
 }
 
-// Change maxiter
-void change_maxiter(double xmin, double xmax, double ymin, double ymax, int maxiter, int num_threads) {
-	maxiter *= 5; 
-	create_threads(xmin, xmax, ymin, ymax, maxiter, num_threads); 
-	return; 
+// Block until the frame in flight is drawn completely
+void finish_frame() {
+	if (frame_running) {
+		pool_wait(workers); 
+		end_frame(); 
+	}
 }
 
 int main( int argc, char *argv[] )
@@ -227,82 +277,123 @@ int main( int argc, char *argv[] )
 	double xmax= 0.5;
 	double ymin=-1.0;
 	double ymax= 1.0;
-	int num_threads = 1; 
 
 	// Maximum number of iterations to compute.
 	// Higher values take longer but have more detail.
 	int maxiter=500;
 
-	// Open a new window.
-	gfx_open(640,480,"Mandelbrot Fractal");
+	// Let the command line change the view, the window size and the thread count
+	render_options opts = { 0, 640, 480, {0}, pool_nproc(), 0, 0, 0 }; 
+	view_init(&opts.view,xmin,xmax,ymin,ymax,maxiter);
+	render_parse(argc, argv, &opts); 
+	int num_threads = opts.threads; 
+
+	// The view that the navigation commands move around
+	viewport view = opts.view; 
+
+	// Start with the colors this program has always had
+	palette_init(&frame_palette, 1); 
+
+	// Start the worker threads once, to be reused for every frame
+	workers = pool_create(num_threads); 
+	rectqueue_init(&shown, PRESENT_QUEUE); 
 
 	// Show the configuration, just in case you want to recreate it.
-	printf("coordinates: %lf %lf %lf %lf\n",xmin,xmax,ymin,ymax);
+	view_print(&view);
+
+	// With an output file, draw one frame in memory and write it out
+	if (opts.output) {
+		gfx_open_headless(opts.width, opts.height); 
+		double start = render_time(); 
+		create_threads(&view, num_threads); 
+		finish_frame(); 
+		render_report(frame_map.iters, opts.width, opts.height, render_time()-start); 
+		int status = render_write(opts.output, gfx_framebuffer(), opts.width, opts.height); 
+		pool_destroy(workers); 
+		exit(status ? 1 : 0); 
+	}
+
+	// Open a new window.
+	gfx_open(opts.width,opts.height,"Mandelbrot Fractal");
 
 	// Fill it with a dark blue initially.
 	gfx_clear_color(0,0,255);
 	gfx_clear();
 
 	// Display the fractal image
-	create_threads(xmin,xmax,ymin,ymax,maxiter,num_threads);
-	gfx_flush();
+	create_threads(&view,num_threads);
 	int c = 0;
+	int running;
 	while(1) {
-		// Wait for a key or mouse click.
-		if (gfx_event_waiting()) {
-		c = gfx_wait();
+		// Wait for a key or mouse click, while the frame is drawn.
+		if (next_event(&c)) {
 
 		switch (c) {
 			case ('r'):
 				// Move right
-				move_right(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_move(&view, 0.25, 0); 
+				create_threads(&view, num_threads); 
 				break;  
 			case ('l'):
 				// Move left
-				move_left(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_move(&view, -0.25, 0); 
+				create_threads(&view, num_threads); 
 				break;
 			case ('u'):
 				// Move up
-				move_up(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_move(&view, 0, -0.25); 
+				create_threads(&view, num_threads); 
 				break;  
 			case ('d'):
 				// Move down
-				move_down(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_move(&view, 0, 0.25); 
+				create_threads(&view, num_threads); 
 				break; 
 			case ('q'):
 				// Quit if q is pressed
+				cancel_frame(); 
+				pool_destroy(workers); 
+				rectqueue_free(&shown); 
 				exit(0); 
 			case ('i'): 
 				// Zoom in
-				zoom_in(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_zoom(&view, 0.5); 
+				create_threads(&view, num_threads); 
 				break;
 			case ('+'):
 				// Zoom in
-				zoom_in(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_zoom(&view, 0.5); 
+				create_threads(&view, num_threads); 
 				break; 
 			case ('o'):
 				// Zoom out
-				zoom_out(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_zoom(&view, 2); 
+				create_threads(&view, num_threads); 
 				break;
 			case ('-'):
 				// Zoom out
-				zoom_out(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_zoom(&view, 2); 
+				create_threads(&view, num_threads); 
 				break;
 			case (1):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				create_threads(&view, num_threads); 
 				break;  
 			case (2):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				create_threads(&view, num_threads); 
 				break; 
 			case (3):
 				// Recenter
-				recenter(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_recenter(&view, gfx_xpos(), gfx_ypos(), gfx_xsize(), gfx_ysize()); 
+				create_threads(&view, num_threads); 
 				break; 
 			case ('m'):
 				// Change maxiter
-				change_maxiter(xmin, xmax, ymin, ymax, maxiter, num_threads); 
+				view_change_maxiter(&view, 5); 
+				create_threads(&view, num_threads); 
 				break; 
 			case ('1'):
 				// Run with 1 thread
@@ -336,10 +427,36 @@ int main( int argc, char *argv[] )
 				// Run with 8 threads
 				num_threads = 8;   
 				break; 
+			case ('c'):
+				// Next palette
+				running = cancel_frame(); 
+				palette_next_scheme(&frame_palette); 
+				recolor_image(&view, num_threads, running); 
+				break; 
+			case ('x'):
+				// Next color scale
+				running = cancel_frame(); 
+				palette_next_scale(&frame_palette); 
+				recolor_image(&view, num_threads, running); 
+				break; 
+			case ('n'):
+				// Toggle smooth coloring
+				running = cancel_frame(); 
+				palette_toggle_smooth(&frame_palette); 
+				recolor_image(&view, num_threads, running); 
+				break; 
+			case ('e'):
+				// Toggle histogram equalization
+				running = cancel_frame(); 
+				palette_toggle_equalize(&frame_palette); 
+				recolor_image(&view, num_threads, running); 
+				break; 
 			default:
 				break; 
 		}
-		} 
+		} else {
+			idle(); 
+		}
 	}
 	return 0;
 }
@@ -0,0 +1,508 @@
+/*
+frame.c - Iteration counts for the pixels of one frame
+*/
+
+#include "frame.h"
+#include "mandel.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+/*
+For a deep zoom, xmin..ymax hold the bounds relative to the center, and
+the orbit Z of the center c0 is computed once, beyond double precision.  A pixel at
+c0 + dc has the orbit Z + dz, where
+
+  dz' = (2Z + dz) dz + dc
+
+only involves small numbers, which doubles hold well.  The reference
+orbit may fail to describe its neighbors, when it escapes before them,
+or when z comes closer to 0 than dz, which is where the perturbed orbit
+loses its precision (a glitch).  In both cases z itself becomes the new
+dz, against the reference orbit restarted at Z = 0 (rebasing).
+*/
+
+/*
+A double-double holds a number as the unevaluated sum hi + lo of two
+doubles, for about 32 significant digits, using only double arithmetic
+with exact error terms (Dekker's product and Knuth's sum).  It is much
+faster than a software __float128.
+*/
+
+typedef struct {
+	double hi; 
+	double lo; 
+} frame_dd; 
+
+static frame_dd dd_sum( double a, double b )
+{
+	frame_dd r; 
+	r.hi = a + b; 
+	double bb = r.hi - a; 
+	r.lo = (a - (r.hi - bb)) + (b - bb); 
+	return r; 
+}
+
+static frame_dd dd_fast_sum( double a, double b )
+{
+	frame_dd r; 
+	r.hi = a + b; 
+	r.lo = b - (r.hi - a); 
+	return r; 
+}
+
+static frame_dd dd_product( double a, double b )
+{
+	const double split = 134217729.0; 
+	double ta = split*a, tb = split*b; 
+	double ah = ta - (ta - a), al = a - ah; 
+	double bh = tb - (tb - b), bl = b - bh; 
+	frame_dd r; 
+	r.hi = a*b; 
+	r.lo = ((ah*bh - r.hi) + ah*bl + al*bh) + al*bl; 
+	return r; 
+}
+
+static frame_dd dd_add( frame_dd a, frame_dd b )
+{
+	frame_dd s = dd_sum(a.hi, b.hi); 
+	frame_dd t = dd_sum(a.lo, b.lo); 
+	s = dd_fast_sum(s.hi, s.lo + t.hi); 
+	return dd_fast_sum(s.hi, s.lo + t.lo); 
+}
+
+static frame_dd dd_neg( frame_dd a )
+{
+	a.hi = -a.hi; 
+	a.lo = -a.lo; 
+	return a; 
+}
+
+static frame_dd dd_mul( frame_dd a, frame_dd b )
+{
+	frame_dd p = dd_product(a.hi, b.hi); 
+	return dd_fast_sum(p.hi, p.lo + (a.hi*b.lo + a.lo*b.hi)); 
+}
+
+static frame_dd dd_from( view_real x )
+{
+	frame_dd r; 
+	r.hi = (double) x; 
+	r.lo = (double) (x - r.hi); 
+	return r; 
+}
+
+#define FRAME_PASTE(a,b) a##b
+#define FRAME_NAME(a,b) FRAME_PASTE(a,b)
+
+#define ORBIT(name) FRAME_NAME(name,_dd)
+#define REAL frame_dd
+#define R_FROM(x) dd_from(x)
+#define R_DOUBLE(a) ((a).hi)
+#define R_ADD(a,b) dd_add(a,b)
+#define R_SUB(a,b) dd_add(a,dd_neg(b))
+#define R_MUL(a,b) dd_mul(a,b)
+#include "frame_orbit.h"
+
+#define ORBIT(name) FRAME_NAME(name,_quad)
+#define REAL view_real
+#define R_FROM(x) ((view_real) (x))
+#define R_DOUBLE(a) ((double) (a))
+#define R_ADD(a,b) ((a)+(b))
+#define R_SUB(a,b) ((a)-(b))
+#define R_MUL(a,b) ((a)*(b))
+#include "frame_orbit.h"
+
+static const char *frame_forced = 0; 
+static int frame_series_enabled = 1; 
+
+__attribute__((constructor))
+static void frame_select_precision()
+{
+	const char *want = getenv("MANDEL_PRECISION"); 
+	if (want && *want && strcmp(want, "auto")) {
+		frame_forced = want; 
+	}
+
+	const char *series = getenv("MANDEL_SERIES"); 
+	if (series && !strcmp(series, "0")) {
+		frame_series_enabled = 0; 
+	}
+}
+
+static const char *frame_names[] = { "float", "double", "dd", "quad", "perturb" }; 
+
+// Pick the cheapest precision that resolves pixels of the given size
+static int frame_choose( double pixel, int maxiter )
+{
+	int p; 
+
+	if (frame_forced) {
+		for (p=FRAME_FLOAT; p<=FRAME_PERTURB; p++) {
+			if (!strcmp(frame_forced, frame_names[p])) {
+				return p; 
+			}
+		}
+	}
+	if (pixel >= FRAME_FLOAT_PIXEL && maxiter <= FRAME_FLOAT_MAXITER) {
+		return FRAME_FLOAT; 
+	}
+	if (pixel >= FRAME_DEEP_PIXEL) {
+		return FRAME_DOUBLE; 
+	}
+	return FRAME_PERTURB; 
+}
+
+static void frame_reserve( frame *f )
+{
+	if (f->maxiter+1 > f->ref_capacity) {
+		free(f->ref_r); 
+		free(f->ref_i); 
+		f->ref_capacity = f->maxiter+1; 
+		f->ref_r = (double *) malloc (f->ref_capacity*sizeof(double)); 
+		f->ref_i = (double *) malloc (f->ref_capacity*sizeof(double)); 
+		if (!f->ref_r || !f->ref_i) {
+			fprintf(stderr, "frame_begin: out of memory.\n"); 
+			exit(1); 
+		}
+	}
+}
+
+/*
+Series approximation.  With dz = sum of b[k] u^k, where dc = r u, the
+perturbed step dz' = 2Z dz + dz^2 + dc gives the coefficients
+
+  b[k]' = 2Z b[k] + sum of b[i] b[k-i] for 0 < i < k, plus r for k = 1
+
+which only depend on the reference orbit, so they are carried along it
+once for the whole frame.  Scaling by r keeps |u| <= 1, so the terms
+neither overflow nor underflow however deep the zoom.  The series stops
+at the first iteration where its last term grows past the tolerance, or
+where it misses the orbit of a probe pixel, iterated in full, by more
+than the tolerance.  A probe that escapes or would be rebased stops it
+too.  The tolerance is a fraction of the width of a pixel carried to
+that iteration, |b[1]| / r per unit of dc.
+*/
+
+#define FRAME_PROBES 12
+
+static void frame_series( frame *f )
+{
+	static const double probe_u[FRAME_PROBES][2] = {
+		{ -1, -1 }, { 0, -1 }, { 1, -1 }, { -1, 0 }, { 1, 0 }, { -1, 1 }, { 0, 1 }, { 1, 1 },
+		{ -0.5, -0.5 }, { 0.5, -0.5 }, { -0.5, 0.5 }, { 0.5, 0.5 },
+	}; 
+	const int terms = FRAME_SERIES_TERMS; 
+	double br[FRAME_SERIES_TERMS] = { 0 }, bi[FRAME_SERIES_TERMS] = { 0 }; 
+	double dcr[FRAME_PROBES], dci[FRAME_PROBES], dr[FRAME_PROBES] = { 0 }, di[FRAME_PROBES] = { 0 }; 
+	double r = hypot(f->xmax, f->ymax); 
+	double pixel = (f->xmax - f->xmin) / f->width; 
+	int n, k, i, p; 
+
+	f->skip = 0; 
+	f->series_radius = r; 
+	if (!frame_series_enabled) {
+		return; 
+	}
+
+	for (p=0; p<FRAME_PROBES; p++) {
+		dcr[p] = probe_u[p][0] * f->xmax; 
+		dci[p] = probe_u[p][1] * f->ymax; 
+	}
+
+	for (n=0; n+1 < f->ref_length; n++) {
+		double zr = f->ref_r[n], zi = f->ref_i[n]; 
+
+		// Step the coefficients from the highest down, since each uses the lower ones
+		for (k=terms-1; k>=0; k--) {
+			double nr = 2*(zr*br[k] - zi*bi[k]), ni = 2*(zr*bi[k] + zi*br[k]); 
+			for (i=0; i<k; i++) {
+				nr += br[i]*br[k-1-i] - bi[i]*bi[k-1-i]; 
+				ni += br[i]*bi[k-1-i] + bi[i]*br[k-1-i]; 
+			}
+			br[k] = nr + (k == 0 ? r : 0); 
+			bi[k] = ni; 
+		}
+
+		double tolerance = FRAME_SERIES_TOLERANCE * hypot(br[0], bi[0]) * pixel / r; 
+		if (hypot(br[terms-1], bi[terms-1]) > tolerance) {
+			break; 
+		}
+
+		zr = f->ref_r[n+1]; 
+		zi = f->ref_i[n+1]; 
+		for (p=0; p<FRAME_PROBES; p++) {
+			double tr = 2*f->ref_r[n] + dr[p], ti = 2*f->ref_i[n] + di[p]; 
+			double nr = tr*dr[p] - ti*di[p] + dcr[p]; 
+			di[p] = tr*di[p] + ti*dr[p] + dci[p]; 
+			dr[p] = nr; 
+
+			double mag = (zr+dr[p])*(zr+dr[p]) + (zi+di[p])*(zi+di[p]); 
+			if (mag >= 16 || mag < dr[p]*dr[p] + di[p]*di[p]) {
+				break; 
+			}
+
+			// Evaluate the series at the probe by Horner's rule
+			double ur = dcr[p] / r, ui = dci[p] / r; 
+			double sr = br[terms-1], si = bi[terms-1]; 
+			for (k=terms-2; k>=0; k--) {
+				double t = sr*ur - si*ui + br[k]; 
+				si = sr*ui + si*ur + bi[k]; 
+				sr = t; 
+			}
+			double t = sr*ur - si*ui; 
+			si = sr*ui + si*ur; 
+			sr = t; 
+
+			if (hypot(sr - dr[p], si - di[p]) > tolerance) {
+				break; 
+			}
+		}
+		if (p < FRAME_PROBES) {
+			break; 
+		}
+
+		f->skip = n+1; 
+		for (k=0; k<terms; k++) {
+			f->series_r[k] = br[k]; 
+			f->series_i[k] = bi[k]; 
+		}
+	}
+}
+
+void frame_begin( frame *f, const viewport *v, itermap *m )
+{
+	int width = m->width, height = m->height; 
+	double pixel = v->scale / width; 
+	int precision = frame_choose(pixel, v->maxiter); 
+
+	// Say so whenever zooming moves the frame to another precision
+	if (!f->width || precision != f->precision) {
+		fprintf(stderr, "precision: %s\n", frame_names[precision]); 
+	}
+
+	// Orbits can be carried on in the precision they were started in.
+	// Perturbation recomputes the whole frame: the reference orbit is
+	// computed again for the new maxiter, and the pixels carried on
+	// against it do not match a fresh frame.
+	f->resume = 0; 
+	if (m->resume && m->resume == f->maxiter && precision == f->precision && precision <= FRAME_DOUBLE) {
+		f->resume = m->resume; 
+	}
+
+	f->map = m; 
+	f->width = width; 
+	f->height = height; 
+	f->maxiter = v->maxiter; 
+	f->precision = precision; 
+	f->xcenter = v->xcenter; 
+	f->ycenter = v->ycenter; 
+
+	if (f->precision >= FRAME_DD) {
+		f->xmin = -v->scale / 2; 
+		f->xmax = v->scale / 2; 
+		f->ymin = -v->scale * v->aspect / 2; 
+		f->ymax = v->scale * v->aspect / 2; 
+	} else {
+		view_bounds(v, &f->xmin, &f->xmax, &f->ymin, &f->ymax); 
+	}
+
+	if (f->precision == FRAME_PERTURB) {
+		frame_reserve(f); 
+		if (pixel >= FRAME_QUAD_PIXEL) {
+			frame_reference_dd(f); 
+		} else {
+			frame_reference_quad(f); 
+		}
+		frame_series(f); 
+	}
+}
+
+/*
+Iterate the point at dcr + i dci from the center by perturbation.  dz
+and m hold where the orbit stands after from iterations, if from is
+not 0, and where it stopped on return.
+*/
+static int frame_perturb( const frame *f, double dcr, double dci, double *dzr, double *dzi, int *mref, int from )
+{
+	const double *zr = f->ref_r, *zi = f->ref_i; 
+	double dr = 0, di = 0; 
+	int m = 0, iter = 0; 
+
+	if (from) {
+		// Carry on from the last frame, unless the orbit escaped on its very last iteration
+		dr = *dzr; 
+		di = *dzi; 
+		m = *mref; 
+		iter = from; 
+		double r = zr[m] + dr, i = zi[m] + di; 
+		if (r*r + i*i >= 16) {
+			return iter; 
+		}
+	} else if (f->skip) {
+		// Start from the series, at iteration skip of the reference orbit
+		double ur = dcr / f->series_radius, ui = dci / f->series_radius; 
+		int k; 
+		for (k=FRAME_SERIES_TERMS-1; k>=0; k--) {
+			double t = dr*ur - di*ui + f->series_r[k]; 
+			di = dr*ui + di*ur + f->series_i[k]; 
+			dr = t; 
+		}
+		double t = dr*ur - di*ui; 
+		di = dr*ui + di*ur; 
+		dr = t; 
+		m = iter = f->skip; 
+	}
+
+	while (iter < f->maxiter) {
+		double tr = 2*zr[m] + dr, ti = 2*zi[m] + di; 
+		double nr = tr*dr - ti*di + dcr; 
+		di = tr*di + ti*dr + dci; 
+		dr = nr; 
+		m++; 
+		iter++; 
+
+		double r = zr[m] + dr, i = zi[m] + di; 
+		double mag = r*r + i*i; 
+		if (mag >= 16) {
+			break; 
+		}
+		if (mag < dr*dr + di*di || m == f->ref_length) {
+			dr = r; 
+			di = i; 
+			m = 0; 
+		}
+	}
+
+	*dzr = dr; 
+	*dzi = di; 
+	*mref = m; 
+	return iter; 
+}
+
+/*
+Return how far past the iteration count an orbit that escaped with
+|z|^2 = mag would have crossed the escape radius 4 if z moved on
+continuously, from 0 at |z| = 16 up to 1 right at |z| = 4 (the
+normalized iteration count).  It carries the count smoothly across
+the bands between counts.
+*/
+static float frame_fraction( double mag )
+{
+	double t = 1 - log2(log(mag) / log(16)); 
+	return t > 0 ? (t < 1 ? t : 1) : 0; 
+}
+
+/*
+Compute the iterations of n points, given as offsets in the frame's
+coordinates and as the indexes pix of their pixels in the map, where
+their orbits and the fractions of their counts are kept.  When
+resuming, the pixels that escaped by the last maxiter keep their
+counts, and the others carry on from there.
+*/
+static void frame_points( const frame *f, const int *pix, const double *x, const double *y, int n, int *iters )
+{
+	itermap *map = f->map; 
+	int from = f->resume; 
+	double xs[n], ys[n], zr[n], zi[n], mags[n]; 
+	int ms[n], is[n], index[n]; 
+	int smooth = 1; 
+	int k, c = 0; 
+
+	for (k=0; k<n; k++) {
+		if (from && map->iters[pix[k]] < from) {
+			iters[k] = map->iters[pix[k]]; 
+			continue; 
+		}
+		xs[c] = x[k]; 
+		ys[c] = y[k]; 
+		zr[c] = from ? map->orbit_r[pix[k]] : 0; 
+		zi[c] = from ? map->orbit_i[pix[k]] : 0; 
+		ms[c] = from ? map->orbit_m[pix[k]] : 0; 
+		index[c] = k; 
+		c++; 
+	}
+
+	switch (f->precision) {
+		case FRAME_FLOAT: 
+			mandel_orbits_float(xs, ys, zr, zi, c, from, f->maxiter, is); 
+			smooth = mandel_smooth_enabled(); 
+			break; 
+		case FRAME_DOUBLE: 
+			mandel_orbits(xs, ys, zr, zi, c, from, f->maxiter, is); 
+			smooth = mandel_smooth_enabled(); 
+			break; 
+		case FRAME_DD: 
+			for (k=0; k<c; k++) {
+				is[k] = frame_point_dd(f, xs[k], ys[k], &mags[k]); 
+			}
+			break; 
+		case FRAME_QUAD: 
+			for (k=0; k<c; k++) {
+				is[k] = frame_point_quad(f, xs[k], ys[k], &mags[k]); 
+			}
+			break; 
+		default: 
+			for (k=0; k<c; k++) {
+				is[k] = frame_perturb(f, xs[k], ys[k], &zr[k], &zi[k], &ms[k], from); 
+				double r = f->ref_r[ms[k]] + zr[k], i = f->ref_i[ms[k]] + zi[k]; 
+				mags[k] = r*r + i*i; 
+			}
+			break; 
+	}
+
+	for (k=0; k<c; k++) {
+		iters[index[k]] = is[k]; 
+		map->orbit_r[pix[index[k]]] = zr[k]; 
+		map->orbit_i[pix[index[k]]] = zi[k]; 
+		map->orbit_m[pix[index[k]]] = ms[k]; 
+		double mag = f->precision <= FRAME_DOUBLE ? zr[k]*zr[k] + zi[k]*zi[k] : mags[k]; 
+		map->fracs[pix[index[k]]] = smooth && is[k] < f->maxiter ? frame_fraction(mag) : 0; 
+	}
+}
+
+void frame_row( const frame *f, int x0, int n, int y, int *iters )
+{
+	int i; 
+
+	if (n <= 0) {
+		return; 
+	}
+
+	double xs[n], ys[n]; 
+	int pix[n]; 
+	double yc = f->ymin + y*(f->ymax-f->ymin)/f->height; 
+	for (i=0; i<n; i++) {
+		xs[i] = f->xmin + (i+x0)*(f->xmax-f->xmin)/f->width; 
+		ys[i] = yc; 
+		pix[i] = y*f->width + i+x0; 
+	}
+
+	frame_points(f, pix, xs, ys, n, iters); 
+}
+
+void frame_pixels( const frame *f, const int *x, const int *y, int n, int *iters )
+{
+	int k; 
+
+	if (n <= 0) {
+		return; 
+	}
+
+	double xs[n], ys[n]; 
+	int pix[n]; 
+	for (k=0; k<n; k++) {
+		xs[k] = f->xmin + x[k]*(f->xmax-f->xmin)/f->width; 
+		ys[k] = f->ymin + y[k]*(f->ymax-f->ymin)/f->height; 
+		pix[k] = y[k]*f->width + x[k]; 
+	}
+
+	frame_points(f, pix, xs, ys, n, iters); 
+}
+
+const char *frame_precision( const frame *f )
+{
+	return frame_names[f->precision]; 
+}
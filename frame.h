@@ -0,0 +1,96 @@
+/*
+frame.h - Iteration counts for the pixels of one frame
+Maps pixels to points of the view and computes their iterations,
+in floats or doubles, or for deep zooms by perturbation around a
+reference orbit computed in the precision of the view center.
+*/
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "view.h"
+#include "itermap.h"
+
+/*
+Each frame is computed in the cheapest precision that resolves its
+pixels.  Pixels of at least FRAME_FLOAT_PIXEL are iterated in floats,
+twice as many at a time as doubles, as long as maxiter is small enough
+for the rounding of a float orbit not to build up.  A pixel smaller
+than FRAME_DEEP_PIXEL is too small for doubles to place the points of
+neighboring pixels, and to keep their orbits apart, so the frame is
+computed by perturbation around a reference orbit instead.  That orbit
+is computed in double-double down to FRAME_QUAD_PIXEL, and in view_real
+below it.
+
+The environment may set MANDEL_PRECISION to float, double, dd, quad or
+perturb to force one way for every frame.  dd and quad iterate every
+pixel directly in that precision, which is much slower than
+perturbation but makes a good reference to check it against.
+*/
+#define FRAME_FLOAT_PIXEL 1e-3
+#define FRAME_FLOAT_MAXITER 1000
+#define FRAME_DEEP_PIXEL 1e-12
+#define FRAME_QUAD_PIXEL 1e-28
+
+/*
+Every pixel of a deep frame starts at iteration skip instead of 0,
+from dz = b1 u + b2 u^2 + ... + bK u^K, where u is the pixel's offset
+from the center divided by series_radius, the largest offset in the
+frame.  The series is carried along the reference orbit for as long as
+its last term stays below FRAME_SERIES_TOLERANCE of a pixel's width,
+and it agrees to within that with probe pixels iterated in full.  The
+environment may set MANDEL_SERIES=0 to start every pixel at 0.
+*/
+#define FRAME_SERIES_TERMS 8
+#define FRAME_SERIES_TOLERANCE 1e-3
+
+#define FRAME_FLOAT 0
+#define FRAME_DOUBLE 1
+#define FRAME_DD 2
+#define FRAME_QUAD 3
+#define FRAME_PERTURB 4
+
+typedef struct {
+	int width; 
+	int height; 
+	int maxiter; 
+	int precision; 
+	itermap *map; 
+	int resume; 
+	double xmin; 
+	double xmax; 
+	double ymin; 
+	double ymax; 
+	view_real xcenter; 
+	view_real ycenter; 
+	double *ref_r; 
+	double *ref_i; 
+	int ref_length; 
+	int ref_capacity; 
+	int skip; 
+	double series_radius; 
+	double series_r[FRAME_SERIES_TERMS]; 
+	double series_i[FRAME_SERIES_TERMS]; 
+} frame; 
+
+/*
+Set up the frame for an image of the view the size of the map, which
+itermap_begin has just set up, printing the precision to stderr when
+it changes.  Pixels computed for the frame keep their orbits, and the
+fractions of their counts, in the map, and if the map says so, carry on
+the orbits of the last frame.  For a deep zoom
+this computes the reference orbit at the center of the view, so it
+must not be called while other threads are computing pixels.
+*/
+void frame_begin( frame *f, const viewport *v, itermap *m );
+
+/* Compute the iterations of the n pixels x0..x0+n-1 of row y. */
+void frame_row( const frame *f, int x0, int n, int y, int *iters );
+
+/* Compute the iterations of the n pixels (x[k],y[k]). */
+void frame_pixels( const frame *f, const int *x, const int *y, int n, int *iters );
+
+/* Return the name of the precision the frame is computed in. */
+const char *frame_precision( const frame *f );
+
+#endif
@@ -0,0 +1,68 @@
+/*
+frame_orbit.h - Orbits in a precision beyond double, written once for
+every such precision.
+
+frame.c includes this file once per precision, after defining:
+
+  ORBIT(name)   the name of a function for this precision
+  REAL          the number type
+  R_FROM(x)     a view_real converted to REAL
+  R_DOUBLE(a)   a REAL rounded to a double
+  R_ADD(a,b) R_SUB(a,b) R_MUL(a,b)
+                the arithmetic on REAL
+
+The escape test is made on the orbit rounded to doubles, which only
+matters for points that land within rounding of |z| = 4.  The
+definitions are undone at the end, so the next precision can define
+its own.
+*/
+
+/* Compute the reference orbit of the center of the frame, storing it as doubles. */
+static void ORBIT(frame_reference)( frame *f )
+{
+	REAL cr = R_FROM(f->xcenter), ci = R_FROM(f->ycenter);
+	REAL zr = R_FROM(0), zi = R_FROM(0);
+	int m;
+
+	f->ref_r[0] = 0;
+	f->ref_i[0] = 0;
+	for (m=1; m<=f->maxiter; m++) {
+		REAL t = R_ADD(R_SUB(R_MUL(zr,zr), R_MUL(zi,zi)), cr);
+		zi = R_ADD(R_MUL(R_ADD(zr,zr), zi), ci);
+		zr = t;
+		f->ref_r[m] = R_DOUBLE(zr);
+		f->ref_i[m] = R_DOUBLE(zi);
+		if (f->ref_r[m]*f->ref_r[m] + f->ref_i[m]*f->ref_i[m] >= 16) {
+			break;
+		}
+	}
+	f->ref_length = m <= f->maxiter ? m : f->maxiter;
+}
+
+/* Iterate the point at dcr + i dci from the center directly, in REAL, setting mag to |z|^2 where it stopped. */
+static int ORBIT(frame_point)( const frame *f, double dcr, double dci, double *mag )
+{
+	REAL cr = R_FROM(f->xcenter + dcr), ci = R_FROM(f->ycenter + dci);
+	REAL zr = R_FROM(0), zi = R_FROM(0);
+	int iter;
+
+	for (iter=0; iter<f->maxiter; iter++) {
+		REAL t = R_ADD(R_SUB(R_MUL(zr,zr), R_MUL(zi,zi)), cr);
+		zi = R_ADD(R_MUL(R_ADD(zr,zr), zi), ci);
+		zr = t;
+		double r = R_DOUBLE(zr), i = R_DOUBLE(zi);
+		*mag = r*r + i*i;
+		if (*mag >= 16) {
+			return iter+1;
+		}
+	}
+	return f->maxiter;
+}
+
+#undef ORBIT
+#undef REAL
+#undef R_FROM
+#undef R_DOUBLE
+#undef R_ADD
+#undef R_SUB
+#undef R_MUL
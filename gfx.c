@@ -10,10 +10,14 @@ Version 2, 9/23/2011 - Fixes a bug that could result in jerky animation.
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
 
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "gfx.h"
 
@@ -27,6 +31,8 @@ static Window  gfx_window;
 static GC      gfx_gc;
 static Colormap gfx_colormap;
 static int      gfx_fast_color_mode = 0;
+static unsigned long gfx_red_mask, gfx_green_mask, gfx_blue_mask;
+static unsigned int gfx_foreground_rgb = ~0u;
 
 /* These values are saved by gfx_wait then retrieved later by gfx_xpos and gfx_ypos. */
 
@@ -35,6 +41,23 @@ static int saved_ypos = 0;
 static int saved_xsize = 0;
 static int saved_ysize = 0;
 
+/*
+The offscreen framebuffer, whose pixels are always 0x00RRGGBB.  On a 24 or
+32 bit truecolor display that lays its pixels out the same way it is the
+data of an XImage, placed in shared memory with the server when the MIT-SHM
+extension is available and the server has the byte order of this machine,
+so a blit is a single request with no copy through the socket.  Otherwise
+it is plain memory drawn point by point.
+*/
+
+static XImage         *gfx_image = 0;
+static XShmSegmentInfo gfx_shminfo;
+static int             gfx_shm_mode = 0;
+static unsigned int   *gfx_pixels = 0;
+static int             gfx_fb_xsize = 0;
+static int             gfx_fb_ysize = 0;
+static int             gfx_shm_failed = 0;
+
 /* Open a new graphics window. */
 
 void gfx_open( int width, int height, const char *title )
@@ -48,6 +71,9 @@ void gfx_open( int width, int height, const char *title )
 	Visual *visual = DefaultVisual(gfx_display,0);
 	if(visual && visual->class==TrueColor) {
 		gfx_fast_color_mode = 1;
+		gfx_red_mask = visual->red_mask;
+		gfx_green_mask = visual->green_mask;
+		gfx_blue_mask = visual->blue_mask;
 	} else {
 		gfx_fast_color_mode = 0;
 	}
@@ -87,6 +113,15 @@ void gfx_open( int width, int height, const char *title )
 	saved_ysize = height;
 }
 
+/* Set up a framebuffer with no display, for rendering into memory. */
+
+void gfx_open_headless( int width, int height )
+{
+	gfx_display = 0;
+	saved_xsize = width;
+	saved_ysize = height;
+}
+
 /* Draw a single point at (x,y) */
 
 void gfx_point( int x, int y )
@@ -101,6 +136,21 @@ void gfx_line( int x1, int y1, int x2, int y2 )
 	XDrawLine(gfx_display,gfx_window,gfx_gc,x1,y1,x2,y2);
 }
 
+/* Scale an 8 bit channel to the bits of a truecolor visual's mask. */
+
+static unsigned long gfx_channel( int c, unsigned long mask )
+{
+	int shift = 0, bits = 0;
+
+	if(!mask) return 0;
+	while(!(mask>>shift & 1)) shift++;
+	while(mask>>(shift+bits) & 1) bits++;
+
+	unsigned long value = c&0xff;
+	value = bits<8 ? value>>(8-bits) : value<<(bits-8);
+	return value<<shift & mask;
+}
+
 /* Change the current drawing color. */
 
 void gfx_color( int r, int g, int b )
@@ -109,7 +159,7 @@ void gfx_color( int r, int g, int b )
 
 	if(gfx_fast_color_mode) {
 		/* If this is a truecolor display, we can just pick the color directly. */
-		color.pixel = ((b&0xff) | ((g&0xff)<<8) | ((r&0xff)<<16) );
+		color.pixel = gfx_channel(r,gfx_red_mask) | gfx_channel(g,gfx_green_mask) | gfx_channel(b,gfx_blue_mask);
 	} else {
 		/* Otherwise, we have to allocate it from the colormap of the display. */
 		color.pixel = 0;
@@ -120,12 +170,23 @@ void gfx_color( int r, int g, int b )
 	}
 
 	XSetForeground(gfx_display, gfx_gc, color.pixel);
+	gfx_foreground_rgb = ~0u;
+}
+
+/* Set the drawing color to a framebuffer value, unless it is already the current one. */
+
+static void gfx_foreground( unsigned int p )
+{
+	if(p==gfx_foreground_rgb) return;
+	gfx_color((p>>16)&0xff,(p>>8)&0xff,p&0xff);
+	gfx_foreground_rgb = p;
 }
 
 /* Clear the graphics window to the background color. */
 
 void gfx_clear()
 {
+	if(!gfx_display) return;
 	XClearWindow(gfx_display,gfx_window);
 }
 
@@ -134,6 +195,8 @@ void gfx_clear()
 void gfx_clear_color( int r, int g, int b )
 {
 	XColor color;
+
+	if(!gfx_display) return;
 	color.pixel = 0;
 	color.red = r<<8;
 	color.green = g<<8;
@@ -221,6 +284,7 @@ int gfx_ypos()
 
 void gfx_flush()
 {
+	if(!gfx_display) return;
 	XFlush(gfx_display);
 }
 
@@ -234,3 +298,212 @@ int gfx_ysize()
 	return saved_ysize;
 }
 
+
+/* Catch the error from XShmAttach when the server cannot share memory with us. */
+
+static int gfx_shm_error( Display *display, XErrorEvent *event )
+{
+	gfx_shm_failed = 1;
+	return 0;
+}
+
+static void gfx_framebuffer_free()
+{
+	if(gfx_image) {
+		if(gfx_shm_mode) {
+			XShmDetach(gfx_display,&gfx_shminfo);
+			XSync(gfx_display,False);
+			gfx_image->data = 0;
+			XDestroyImage(gfx_image);
+			shmdt(gfx_shminfo.shmaddr);
+		} else {
+			XDestroyImage(gfx_image);
+		}
+	} else {
+		free(gfx_pixels);
+	}
+	gfx_image = 0;
+	gfx_pixels = 0;
+	gfx_shm_mode = 0;
+}
+
+/* The byte order of this machine, which the framebuffer is written in. */
+
+static int gfx_host_byte_order()
+{
+	unsigned int one = 1;
+	return *(unsigned char *) &one ? LSBFirst : MSBFirst;
+}
+
+static XImage * gfx_framebuffer_shm( Visual *visual, int depth, int width, int height )
+{
+	/* The server reads shared memory as it is, with no byte swapping. */
+	if(!XShmQueryExtension(gfx_display) || ImageByteOrder(gfx_display)!=gfx_host_byte_order()) return 0;
+
+	XImage *image = XShmCreateImage(gfx_display,visual,depth,ZPixmap,0,&gfx_shminfo,width,height);
+	if(!image) return 0;
+
+	if(image->bits_per_pixel!=32) {
+		XDestroyImage(image);
+		return 0;
+	}
+
+	gfx_shminfo.shmid = shmget(IPC_PRIVATE,(size_t) image->bytes_per_line*height,IPC_CREAT|0600);
+	if(gfx_shminfo.shmid<0) {
+		XDestroyImage(image);
+		return 0;
+	}
+
+	gfx_shminfo.shmaddr = image->data = shmat(gfx_shminfo.shmid,0,0);
+	gfx_shminfo.readOnly = False;
+
+	XSync(gfx_display,False);
+	gfx_shm_failed = 0;
+	int (*handler)(Display *, XErrorEvent *) = XSetErrorHandler(gfx_shm_error);
+	XShmAttach(gfx_display,&gfx_shminfo);
+	XSync(gfx_display,False);
+	XSetErrorHandler(handler);
+
+	// The segment goes away once both we and the server have detached.
+	shmctl(gfx_shminfo.shmid,IPC_RMID,0);
+
+	if(image->data==(char *)-1 || gfx_shm_failed) {
+		if(image->data!=(char *)-1) shmdt(image->data);
+		image->data = 0;
+		XDestroyImage(image);
+		return 0;
+	}
+
+	return image;
+}
+
+/* Return the offscreen framebuffer, reallocating it if the window size changed. */
+
+unsigned int *gfx_framebuffer()
+{
+	int width = saved_xsize;
+	int height = saved_ysize;
+
+	if(gfx_pixels && width==gfx_fb_xsize && height==gfx_fb_ysize) {
+		return gfx_pixels;
+	}
+
+	gfx_framebuffer_free();
+
+	// Without a display, the framebuffer is plain memory
+	Visual *visual = gfx_display ? DefaultVisual(gfx_display,DefaultScreen(gfx_display)) : 0;
+	int depth = gfx_display ? DefaultDepth(gfx_display,DefaultScreen(gfx_display)) : 0;
+
+	if(gfx_display && gfx_fast_color_mode && (depth==24 || depth==32)
+	   && gfx_red_mask==0xff0000 && gfx_green_mask==0xff00 && gfx_blue_mask==0xff) {
+		gfx_image = gfx_framebuffer_shm(visual,depth,width,height);
+		if(gfx_image) {
+			gfx_shm_mode = 1;
+		} else {
+			char *data = calloc(width*height,sizeof(unsigned int));
+			gfx_image = XCreateImage(gfx_display,visual,depth,ZPixmap,0,data,width,height,32,width*sizeof(unsigned int));
+			if(gfx_image && gfx_image->bits_per_pixel!=32) {
+				XDestroyImage(gfx_image);
+				gfx_image = 0;
+			} else if(gfx_image) {
+				/* Xlib swaps the bytes for the server as it sends the image. */
+				gfx_image->byte_order = gfx_host_byte_order();
+			} else {
+				free(data);
+			}
+		}
+	}
+
+	if(gfx_image) {
+		gfx_pixels = (unsigned int *) gfx_image->data;
+	} else {
+		gfx_pixels = calloc(width*height,sizeof(unsigned int));
+	}
+
+	if(!gfx_pixels) {
+		fprintf(stderr,"gfx_framebuffer: out of memory.\n");
+		exit(1);
+	}
+
+	gfx_fb_xsize = width;
+	gfx_fb_ysize = height;
+
+	return gfx_pixels;
+}
+
+/* Return the framebuffer value for a color, 0x00RRGGBB whatever the display. */
+
+unsigned int gfx_rgb( int r, int g, int b )
+{
+	return (b&0xff) | ((g&0xff)<<8) | ((r&0xff)<<16);
+}
+
+/* Clip the rectangle at (x,y) to the framebuffer, returning 0 if nothing is left. */
+
+static int gfx_clip( int *x, int *y, int *width, int *height )
+{
+	if(*x<0) { *width += *x; *x = 0; }
+	if(*y<0) { *height += *y; *y = 0; }
+	if(*x+*width>gfx_fb_xsize) *width = gfx_fb_xsize-*x;
+	if(*y+*height>gfx_fb_ysize) *height = gfx_fb_ysize-*y;
+	return *width>0 && *height>0;
+}
+
+/*
+Draw n pixels of the framebuffer from (x,y) rightwards, on a display
+that has no framebuffer image.  Every run of one color is a single
+rectangle, so a row costs a request per change of color rather than
+two per pixel.
+*/
+
+static void gfx_draw_runs( int x, int y, int n )
+{
+	const unsigned int *row = &gfx_pixels[y*gfx_fb_xsize];
+	int i, start;
+
+	for(start=x;start<x+n;start=i) {
+		for(i=start+1;i<x+n && row[i]==row[start];i++);
+		gfx_foreground(row[start]);
+		XFillRectangle(gfx_display,gfx_window,gfx_gc,start,y,i-start,1);
+	}
+}
+
+/* Copy the rectangle at (x,y) of the framebuffer to the window. */
+
+void gfx_blit( int x, int y, int width, int height )
+{
+	int j;
+
+	if(!gfx_pixels || !gfx_display || !gfx_clip(&x,&y,&width,&height)) return;
+
+	if(gfx_shm_mode) {
+		XShmPutImage(gfx_display,gfx_window,gfx_gc,gfx_image,x,y,x,y,width,height,False);
+	} else if(gfx_image) {
+		XPutImage(gfx_display,gfx_window,gfx_gc,gfx_image,x,y,x,y,width,height);
+	} else {
+		/* Not a truecolor display, so each color needs to be allocated. */
+		for(j=y;j<y+height;j++) {
+			gfx_draw_runs(x,j,width);
+		}
+	}
+}
+
+/* Fill a rectangle with one color, in the framebuffer and the window. */
+
+void gfx_fill_rect( int x, int y, int width, int height, unsigned int color )
+{
+	int i, j;
+
+	if(!gfx_pixels || !gfx_clip(&x,&y,&width,&height)) return;
+
+	for(j=y;j<y+height;j++) {
+		unsigned int *row = &gfx_pixels[j*gfx_fb_xsize];
+		for(i=x;i<x+width;i++) {
+			row[i] = color;
+		}
+	}
+	if(!gfx_display) return;
+
+	gfx_foreground(color);
+	XFillRectangle(gfx_display,gfx_window,gfx_gc,x,y,width,height);
+}
@@ -14,6 +14,13 @@ Version 2, 9/23/2011 - Fixes a bug that could result in jerky animation.
 /* Open a new graphics window. */
 void gfx_open( int width, int height, const char *title );
 
+/*
+Set up a width by height framebuffer without opening a window or
+connecting to an X server.  Only the framebuffer and size functions
+may be used; gfx_blit, gfx_clear and gfx_flush do nothing.
+*/
+void gfx_open_headless( int width, int height );
+
 /* Draw a point at (x,y) */
 void gfx_point( int x, int y );
 
@@ -46,4 +53,25 @@ int gfx_event_waiting();
 /* Flush all previous output to the window. */
 void gfx_flush();
 
+/*
+Return the offscreen framebuffer: gfx_xsize() by gfx_ysize() pixels,
+row by row, one value from gfx_rgb per pixel.  Nothing is shown until
+gfx_blit is called.  Different threads may write different pixels
+without locking, but gfx_framebuffer itself must not be called while
+they do, since it reallocates the buffer when the window is resized.
+*/
+unsigned int *gfx_framebuffer();
+
+/*
+Return the framebuffer value for a color, 0x00RRGGBB on any display.
+gfx_blit converts it for visuals that lay their pixels out differently.
+*/
+unsigned int gfx_rgb( int red, int green, int blue );
+
+/* Copy the rectangle at (x,y) of the framebuffer to the window. */
+void gfx_blit( int x, int y, int width, int height );
+
+/* Fill the rectangle at (x,y) with one gfx_rgb color, in the framebuffer and the window, in one request. */
+void gfx_fill_rect( int x, int y, int width, int height, unsigned int color );
+
 #endif
@@ -0,0 +1,129 @@
+/*
+itermap.c - Iteration counts of the last frame
+*/
+
+#include "itermap.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+/*
+Find the shift in pixels from a to b, which are positions in a range of
+the given size spread over n pixels.  Return 0 if the shift is not a
+whole number of pixels or leaves nothing overlapping.  The difference
+is taken in view_real, which keeps it exact at deep zooms.
+*/
+static int pixel_shift( view_real a, view_real b, double range, int n, int *shift )
+{
+	double k = (double) (b - a) * n / range; 
+	double r = floor(k + 0.5); 
+
+	if (fabs(k - r) > 1e-6 || fabs(r) >= n) {
+		return 0; 
+	}
+	*shift = (int) r; 
+	return 1; 
+}
+
+static int same_range( double a, double b )
+{
+	return fabs(a - b) <= 1e-9 * fabs(a); 
+}
+
+// Move the rows of buf so that the new pixel (i,j) holds the old pixel (i+kx,j+ky).
+static void shift_buffer( void *buf, size_t size, int width, int height, int kx, int ky )
+{
+	char *b = (char *) buf; 
+	size_t row = width * size; 
+	int j; 
+
+	if (ky > 0) {
+		memmove(b, b + ky*row, (height-ky)*row); 
+	} else if (ky < 0) {
+		memmove(b - ky*row, b, (height+ky)*row); 
+	} else if (kx > 0) {
+		for (j=0; j<height; j++) {
+			memmove(b + j*row, b + j*row + kx*size, (width-kx)*size); 
+		}
+	} else if (kx < 0) {
+		for (j=0; j<height; j++) {
+			memmove(b + j*row - kx*size, b + j*row, (width+kx)*size); 
+		}
+	}
+}
+
+void itermap_begin( itermap *m, unsigned int *pixels, int width, int height, const viewport *view, int *x, int *y, int *w, int *h )
+{
+	int kx = 0, ky = 0; 
+	int same = m->valid && m->width == width && m->height == height 
+		&& same_range(m->view.scale, view->scale) && same_range(m->view.aspect, view->aspect) 
+		&& m->view.xcenter == view->xcenter && m->view.ycenter == view->ycenter; 
+	int reuse = m->valid && m->width == width && m->height == height && m->view.maxiter == view->maxiter
+		&& same_range(m->view.scale, view->scale) && same_range(m->view.aspect, view->aspect)
+		&& pixel_shift(m->view.xcenter, view->xcenter, view->scale, width, &kx)
+		&& pixel_shift(m->view.ycenter, view->ycenter, view->scale * view->aspect, height, &ky); 
+
+	*x = 0; 
+	*y = 0; 
+	*w = width; 
+	*h = height; 
+	m->resume = 0; 
+
+	if (same && m->orbits && view->maxiter > m->view.maxiter) {
+		// Only maxiter went up: carry on the orbits that had not escaped
+		m->resume = m->view.maxiter; 
+	} else if (reuse && kx == 0 && ky == 0) {
+		// The same view again: nothing is new
+		*w = 0; 
+		*h = 0; 
+	} else if (reuse && ky == 0) {
+		// Moved sideways: only a strip of columns is new
+		shift_buffer(m->iters, sizeof(int), width, height, kx, 0); 
+		shift_buffer(m->fracs, sizeof(float), width, height, kx, 0); 
+		shift_buffer(pixels, sizeof(unsigned int), width, height, kx, 0); 
+		m->orbits = 0; 
+		*x = kx > 0 ? width - kx : 0; 
+		*w = abs(kx); 
+	} else if (reuse && kx == 0) {
+		// Moved up or down: only a strip of rows is new
+		shift_buffer(m->iters, sizeof(int), width, height, 0, ky); 
+		shift_buffer(m->fracs, sizeof(float), width, height, 0, ky); 
+		shift_buffer(pixels, sizeof(unsigned int), width, height, 0, ky); 
+		m->orbits = 0; 
+		*y = ky > 0 ? height - ky : 0; 
+		*h = abs(ky); 
+	} else if (m->width != width || m->height != height) {
+		free(m->iters); 
+		free(m->orbit_r); 
+		free(m->orbit_i); 
+		free(m->orbit_m); 
+		free(m->fracs); 
+		m->iters = (int *) calloc (width*height, sizeof(int)); 
+		m->orbit_r = (double *) calloc (width*height, sizeof(double)); 
+		m->orbit_i = (double *) calloc (width*height, sizeof(double)); 
+		m->orbit_m = (int *) calloc (width*height, sizeof(int)); 
+		m->fracs = (float *) calloc (width*height, sizeof(float)); 
+		if (!m->iters || !m->orbit_r || !m->orbit_i || !m->orbit_m || !m->fracs) {
+			fprintf(stderr, "itermap_begin: out of memory.\n"); 
+			exit(1); 
+		}
+	}
+
+	m->width = width; 
+	m->height = height; 
+	// A shifted frame cannot be resumed: its orbits started from the
+	// points of the old view, which the new one does not compute exactly,
+	// and in the perturbation tier from the old center's reference orbit
+	if (!reuse) {
+		m->orbits = 1; 
+	}
+	m->view = *view; 
+	m->valid = 0; 
+}
+
+void itermap_end( itermap *m )
+{
+	m->valid = 1; 
+}
@@ -0,0 +1,54 @@
+/*
+itermap.h - Iteration counts of the last frame
+Keeping the counts, and the view they belong to, between frames
+lets a frame that overlaps the last one reuse the shared pixels.
+*/
+
+#ifndef ITERMAP_H
+#define ITERMAP_H
+
+#include "view.h"
+
+/*
+fracs holds the fraction of an iteration by which each pixel that
+escaped overshot its count, for smooth coloring, or 0 where it is not
+known, such as for pixels filled without being computed.
+
+Alongside the counts the map keeps the orbit of every pixel where it
+stopped, for frame.c to carry on when only maxiter goes up: z for the
+plain kernels, and dz and the reference orbit index for perturbation.
+orbits is cleared by anything that fills pixels without computing
+their orbits, such as the tile cache or subdivision fills, and by a
+pan, which does not shift the orbits with the counts.
+*/
+typedef struct {
+	int width; 
+	int height; 
+	int *iters; 
+	float *fracs; 
+	double *orbit_r; 
+	double *orbit_i; 
+	int *orbit_m; 
+	int orbits; 
+	viewport view; 
+	int valid; 
+	int resume; 
+} itermap; 
+
+/*
+Get the map ready for a frame of the given view, and set x,y,w,h to the
+rectangle of pixels that must be computed.  If the map holds a complete
+frame of the same size, scale and maxiter, moved by a whole number of
+pixels along one axis, the overlapping pixels are shifted into place in
+both the map and the framebuffer pixels, and the rectangle is only the
+newly exposed strip.  Otherwise it is the whole image.  If it holds a
+complete frame of the same view with a lower maxiter, and the orbits
+of all its pixels, resume is set to that maxiter, and frame.c only
+carries on the pixels that had not escaped by then.
+*/
+void itermap_begin( itermap *m, unsigned int *pixels, int width, int height, const viewport *view, int *x, int *y, int *w, int *h );
+
+/* Mark the frame started by itermap_begin as complete, so the next one may reuse it. */
+void itermap_end( itermap *m );
+
+#endif
@@ -0,0 +1,517 @@
+/*
+mandel.c - Shared Mandelbrot escape-time kernel
+*/
+
+#include "mandel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MANDEL_X86 1
+#endif
+
+/*
+Compute the number of iterations at point x, y
+in the complex space, up to a maximum of max.
+Return the number of iterations at that point.
+
+This computes the Mandelbrot fractal:
+z = z^2 + alpha
+
+Where z is initially zero, and alpha is the location x + iy
+in the complex plane.  Rather than using the "complex" type
+with cpow() and cabs(), we keep the real and imaginary parts
+of z in separate doubles.  The escape test |z| < 4 becomes
+zr^2 + zi^2 < 16, so no square root is needed, and the squares
+computed for the test are reused for the next iteration.
+
+The result is the same as squaring z with an ordinary complex
+multiply (z*z), including the rounding of every step.
+*/
+
+static int mandel_interior_enabled = 1;
+static double mandel_tolerance = MANDEL_TOLERANCE;
+static int mandel_smooth = 1;
+
+/*
+Return 1 if x + iy lies inside the main cardioid or the period-2 bulb.
+With q = (x-1/4)^2 + y^2 the cardioid is q(q + x - 1/4) < y^2/4, and
+the bulb is the disk of radius 1/4 about -1.  Both regions are inside
+the set, so their points never escape and would run all max iterations.
+*/
+
+static int mandel_interior( double x, double y )
+{
+	double xq = x - 0.25;
+	double y2 = y*y;
+	double q = xq*xq + y2;
+
+	if(q*(q+xq) < 0.25*y2) return 1;
+	if((x+1)*(x+1) + y2 < 0.0625) return 1;
+	return 0;
+}
+
+void mandel_set_interior( int enabled )
+{
+	mandel_interior_enabled = enabled;
+}
+
+/*
+Brent's cycle detection: z is saved after iterations 1, 2, 4, 8, ...
+and every later z is compared with the saved one.  Once the saved z
+lies on a cycle, the orbit comes back to it within one period, which
+is found by the time the gap between saves exceeds the period.  A
+point whose orbit comes within the tolerance of an earlier value is
+taken to be caught by an attracting cycle, and so to never escape.
+*/
+
+void mandel_set_periodicity( double tolerance )
+{
+	mandel_tolerance = tolerance;
+}
+
+void mandel_set_smooth( int enabled )
+{
+	mandel_smooth = enabled;
+}
+
+int mandel_smooth_enabled()
+{
+	return mandel_smooth;
+}
+
+/*
+An orbit may be resumed from the z it had after from iterations.  Then
+z itself is saved first, and after that the iterations that are powers
+of two, which for from = 0 is the same as a fresh orbit.  z is left as
+NaN once the orbit is found on a cycle, so a resume knows it never
+escapes.
+*/
+
+static int mandel_next_save( int from )
+{
+	int save = 1;
+	while(save<=from && save<(1<<30)) save *= 2;
+	return save;
+}
+
+static int mandel_orbit( double x, double y, double *zrp, double *zip, int from, int max )
+{
+	double zr = *zrp, zi = *zip;
+	double zr2 = zr*zr, zi2 = zi*zi;
+
+	int iter = from;
+
+	double sr = zr, si = zi;
+	int save = mandel_next_save(from);
+
+	while( zr2+zi2 < 16 && iter < max ) {
+		zi = 2*zr*zi + y;
+		zr = zr2 - zi2 + x;
+		zr2 = zr*zr;
+		zi2 = zi*zi;
+		iter++;
+
+		if(mandel_tolerance>=0) {
+			if(fabs(zr-sr)+fabs(zi-si) <= mandel_tolerance) {
+				*zrp = NAN;
+				return max;
+			}
+			if(iter==save) {
+				sr = zr;
+				si = zi;
+				save *= 2;
+			}
+		}
+	}
+
+	*zrp = zr;
+	*zip = zi;
+	return iter;
+}
+
+int mandel_point( double x, double y, int max )
+{
+	double zr = 0, zi = 0;
+
+	if(mandel_interior_enabled && mandel_interior(x,y)) return max;
+
+	return mandel_orbit(x,y,&zr,&zi,0,max);
+}
+
+static void mandel_orbits_scalar( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters )
+{
+	int i;
+	for(i=0;i<n;i++) {
+		iters[i] = mandel_orbit(x[i],y[i],&zr[i],&zi[i],from,max);
+	}
+}
+
+#ifdef MANDEL_X86
+
+/*
+The vector kernels iterate one group of points per call, one point per
+lane.  Each lane performs exactly the same operations as mandel_point,
+so the double kernels match it bit for bit.  A lane that escapes is
+masked off and its count frozen, although its z keeps being computed
+along with the others; unless the smooth option is off, the z it escaped
+with is kept aside on the (rare) iterations where some lane escapes, and
+stored in its place.  The loop ends once every lane has escaped or
+max is reached.  Counts are kept in the element type so no integer
+vector instructions beyond the base ISA are needed.  The periodicity
+check saves z at the same iterations as mandel_point, which are the
+same for every lane, and a lane found on a cycle gets the count max.
+
+The float kernels run twice as many lanes.  Their counts are exact up
+to 2^24, and their points are only placed to about 1e-7, so they are
+for views where that is far below the size of a pixel.
+
+All six kernels come from mandel_kernel.h.  V(op) names the intrinsic
+for op in the current instruction set and element type.
+*/
+
+#define MANDEL_PASTE(a,b,c) a##b##c
+#define MANDEL_NAME(a,b,c) MANDEL_PASTE(a,b,c)
+
+#define TARGET "sse2"
+#define V(op) MANDEL_NAME(_mm_,op,SUFFIX)
+#define LOAD(p) V(loadu)(p)
+#define ZERO() V(setzero)()
+#define SET1(a) V(set1)(a)
+#define ADD(a,b) V(add)(a,b)
+#define SUB(a,b) V(sub)(a,b)
+#define MUL(a,b) V(mul)(a,b)
+#define ABS(a) V(andnot)(SET1(-0.0),a)
+#define ALL V(castsi128)(_mm_set1_epi32(-1))
+#define NONE V(setzero)()
+#define OR(m,c) V(or)(m,c)
+#define LESS(m,a,b) V(and)(m,V(cmplt)(a,b))
+#define LESSEQ(m,a,b) V(and)(m,V(cmple)(a,b))
+#define ANY(m) V(movemask)(m)
+#define COUNT(c,m,o) ADD(c,V(and)(m,o))
+#define SELECT(c,m,v) V(or)(V(andnot)(m,c),V(and)(m,v))
+#define CLEAR(m,c) V(andnot)(c,m)
+
+#define KERNEL mandel_group_sse2
+#define REAL double
+#define SUFFIX _pd
+#define VEC __m128d
+#define MASK __m128d
+#define STORE(p,c) _mm_storel_epi64((__m128i *)(p),_mm_cvttpd_epi32(c))
+#include "mandel_kernel.h"
+
+#define KERNEL mandel_group_sse2_float
+#define REAL float
+#define SUFFIX _ps
+#define VEC __m128
+#define MASK __m128
+#define STORE(p,c) _mm_storeu_si128((__m128i *)(p),_mm_cvttps_epi32(c))
+#include "mandel_kernel.h"
+
+#undef TARGET
+#undef V
+#undef ALL
+#undef LESS
+#undef LESSEQ
+#undef SELECT
+
+#define TARGET "avx2"
+#define V(op) MANDEL_NAME(_mm256_,op,SUFFIX)
+#define ALL V(castsi256)(_mm256_set1_epi32(-1))
+#define LESS(m,a,b) V(and)(m,V(cmp)(a,b,_CMP_LT_OQ))
+#define LESSEQ(m,a,b) V(and)(m,V(cmp)(a,b,_CMP_LE_OQ))
+#define SELECT(c,m,v) V(blendv)(c,v,m)
+
+#define KERNEL mandel_group_avx2
+#define REAL double
+#define SUFFIX _pd
+#define VEC __m256d
+#define MASK __m256d
+#define STORE(p,c) _mm_storeu_si128((__m128i *)(p),_mm256_cvttpd_epi32(c))
+#include "mandel_kernel.h"
+
+#define KERNEL mandel_group_avx2_float
+#define REAL float
+#define SUFFIX _ps
+#define VEC __m256
+#define MASK __m256
+#define STORE(p,c) _mm256_storeu_si256((__m256i *)(p),_mm256_cvttps_epi32(c))
+#include "mandel_kernel.h"
+
+#undef TARGET
+#undef V
+#undef ABS
+#undef ALL
+#undef NONE
+#undef OR
+#undef LESS
+#undef LESSEQ
+#undef ANY
+#undef COUNT
+#undef SELECT
+#undef CLEAR
+
+#define TARGET "avx512f"
+#define V(op) MANDEL_NAME(_mm512_,op,SUFFIX)
+#define ABS(a) V(abs)(a)
+#define ALL ((MASK)~0)
+#define NONE ((MASK)0)
+#define OR(m,c) ((m)|(c))
+#define LESS(m,a,b) MANDEL_NAME(_mm512_mask_cmp,SUFFIX,_mask)(m,a,b,_CMP_LT_OQ)
+#define LESSEQ(m,a,b) MANDEL_NAME(_mm512_mask_cmp,SUFFIX,_mask)(m,a,b,_CMP_LE_OQ)
+#define ANY(m) (m)
+#define COUNT(c,m,o) V(mask_add)(c,m,c,o)
+#define SELECT(c,m,v) V(mask_mov)(c,m,v)
+#define CLEAR(m,c) ((m)&~(c))
+
+#define KERNEL mandel_group_avx512
+#define REAL double
+#define SUFFIX _pd
+#define VEC __m512d
+#define MASK __mmask8
+#define STORE(p,c) _mm256_storeu_si256((__m256i *)(p),_mm512_cvttpd_epi32(c))
+#include "mandel_kernel.h"
+
+#define KERNEL mandel_group_avx512_float
+#define REAL float
+#define SUFFIX _ps
+#define VEC __m512
+#define MASK __mmask16
+#define STORE(p,c) _mm512_storeu_si512((p),_mm512_cvttps_epi32(c))
+#include "mandel_kernel.h"
+
+#undef TARGET
+#undef V
+#undef LOAD
+#undef ZERO
+#undef SET1
+#undef ADD
+#undef SUB
+#undef MUL
+#undef ABS
+#undef ALL
+#undef NONE
+#undef OR
+#undef LESS
+#undef LESSEQ
+#undef ANY
+#undef COUNT
+#undef SELECT
+#undef CLEAR
+
+#endif
+
+/*
+The instruction set is chosen once, before main runs, from what CPUID
+reports.  Setting MANDEL_ISA=scalar (or sse2, avx2) in the environment
+forces a narrower kernel, which is handy for checking that they agree.
+*/
+
+typedef void (*mandel_group_func)( const double *x, const double *y, double *zr, double *zi, int from, int max, int *iters );
+typedef void (*mandel_group_float_func)( const float *x, const float *y, float *zr, float *zi, int from, int max, int *iters );
+
+static mandel_group_func mandel_group = 0;
+static mandel_group_float_func mandel_group_float = 0;
+static int mandel_lanes = 1;
+static int mandel_lanes_float = 1;
+static const char *mandel_isa_name = "scalar";
+
+static int mandel_isa_allowed( const char *want, const char *isa )
+{
+	return !want || !*want || !strcmp(want,isa);
+}
+
+__attribute__((constructor))
+static void mandel_select_isa()
+{
+#ifdef MANDEL_X86
+	const char *want = getenv("MANDEL_ISA");
+
+	__builtin_cpu_init();
+
+	if(mandel_isa_allowed(want,"avx512") && __builtin_cpu_supports("avx512f")) {
+		mandel_group = mandel_group_avx512;
+		mandel_group_float = mandel_group_avx512_float;
+		mandel_lanes = 8;
+		mandel_isa_name = "avx512";
+	} else if(mandel_isa_allowed(want,"avx2") && __builtin_cpu_supports("avx2")) {
+		mandel_group = mandel_group_avx2;
+		mandel_group_float = mandel_group_avx2_float;
+		mandel_lanes = 4;
+		mandel_isa_name = "avx2";
+	} else if(mandel_isa_allowed(want,"sse2") && __builtin_cpu_supports("sse2")) {
+		mandel_group = mandel_group_sse2;
+		mandel_group_float = mandel_group_sse2_float;
+		mandel_lanes = 2;
+		mandel_isa_name = "sse2";
+	}
+	mandel_lanes_float = 2*mandel_lanes;
+#endif
+
+	const char *interior = getenv("MANDEL_INTERIOR");
+	if(interior && !strcmp(interior,"0")) {
+		mandel_interior_enabled = 0;
+	}
+
+	const char *smooth = getenv("MANDEL_SMOOTH");
+	if(smooth && !strcmp(smooth,"0")) {
+		mandel_smooth = 0;
+	}
+
+	const char *periodicity = getenv("MANDEL_PERIODICITY");
+	if(periodicity && !strcmp(periodicity,"off")) {
+		mandel_tolerance = -1;
+	} else if(periodicity && *periodicity) {
+		mandel_tolerance = atof(periodicity);
+	}
+}
+
+/*
+mandel_orbits works through the points in chunks, so the routines below
+never see more than MANDEL_CHUNK of them at a time.
+*/
+
+#define MANDEL_CHUNK 64
+
+typedef void (*mandel_chunk_func)( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters );
+
+static void mandel_orbits_vector( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters )
+{
+	int i;
+
+	for(i=0;i+mandel_lanes<=n;i+=mandel_lanes) {
+		mandel_group(&x[i],&y[i],&zr[i],&zi[i],from,max,&iters[i]);
+	}
+
+	// Pad the last partial group by repeating its final point.
+	if(i<n) {
+		double xpad[8], ypad[8], zrpad[8], zipad[8];
+		int ipad[8];
+		int k;
+		for(k=0;k<mandel_lanes;k++) {
+			int j = i+k<n ? i+k : n-1;
+			xpad[k] = x[j];
+			ypad[k] = y[j];
+			zrpad[k] = zr[j];
+			zipad[k] = zi[j];
+		}
+		mandel_group(xpad,ypad,zrpad,zipad,from,max,ipad);
+		memcpy(&iters[i],ipad,(n-i)*sizeof(int));
+		memcpy(&zr[i],zrpad,(n-i)*sizeof(double));
+		memcpy(&zi[i],zipad,(n-i)*sizeof(double));
+	}
+}
+
+static void mandel_orbits_vector_float( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters )
+{
+	float xf[MANDEL_CHUNK+16], yf[MANDEL_CHUNK+16];
+	float zrf[MANDEL_CHUNK+16], zif[MANDEL_CHUNK+16];
+	int is[MANDEL_CHUNK+16];
+	int i;
+
+	// Round the points to floats, padding the last group with the final point.
+	for(i=0;i<n || i%mandel_lanes_float;i++) {
+		int j = i<n ? i : n-1;
+		xf[i] = x[j];
+		yf[i] = y[j];
+		zrf[i] = zr[j];
+		zif[i] = zi[j];
+	}
+	for(i=0;i<n;i+=mandel_lanes_float) {
+		mandel_group_float(&xf[i],&yf[i],&zrf[i],&zif[i],from,max,&is[i]);
+	}
+	for(i=0;i<n;i++) {
+		iters[i] = is[i];
+		zr[i] = zrf[i];
+		zi[i] = zif[i];
+	}
+}
+
+/*
+With the interior test on, points inside the cardioid or bulb return max
+at once, and so do points whose z is NaN, which an earlier run found to
+never escape.  The other points of each chunk are packed together, so
+the vector lanes only iterate points that may escape.
+*/
+
+static void mandel_orbits_chunked( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters, mandel_chunk_func orbits )
+{
+	double xs[MANDEL_CHUNK], ys[MANDEL_CHUNK], zrs[MANDEL_CHUNK], zis[MANDEL_CHUNK];
+	int is[MANDEL_CHUNK];
+	int index[MANDEL_CHUNK];
+	int i, k, m;
+
+	for(i=0;i<n;i+=MANDEL_CHUNK) {
+		int end = i+MANDEL_CHUNK < n ? i+MANDEL_CHUNK : n;
+
+		m = 0;
+		for(k=i;k<end;k++) {
+			if(isnan(zr[k]) || (mandel_interior_enabled && mandel_interior(x[k],y[k]))) {
+				iters[k] = max;
+				zr[k] = NAN;
+			} else {
+				xs[m] = x[k];
+				ys[m] = y[k];
+				zrs[m] = zr[k];
+				zis[m] = zi[k];
+				index[m] = k;
+				m++;
+			}
+		}
+
+		if(m>0) orbits(xs,ys,zrs,zis,m,from,max,is);
+		for(k=0;k<m;k++) {
+			iters[index[k]] = is[k];
+			zr[index[k]] = zrs[k];
+			zi[index[k]] = zis[k];
+		}
+	}
+}
+
+void mandel_orbits( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters )
+{
+	mandel_orbits_chunked(x,y,zr,zi,n,from,max,iters,mandel_group ? mandel_orbits_vector : mandel_orbits_scalar);
+}
+
+void mandel_orbits_float( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters )
+{
+	if(!mandel_group_float || max > MANDEL_FLOAT_MAXITER) {
+		mandel_orbits(x,y,zr,zi,n,from,max,iters);
+		return;
+	}
+	mandel_orbits_chunked(x,y,zr,zi,n,from,max,iters,mandel_orbits_vector_float);
+}
+
+void mandel_points( const double *x, const double *y, int n, int max, int *iters )
+{
+	double zr[MANDEL_CHUNK], zi[MANDEL_CHUNK];
+	int i;
+
+	for(i=0;i<n;i+=MANDEL_CHUNK) {
+		int m = n-i < MANDEL_CHUNK ? n-i : MANDEL_CHUNK;
+		memset(zr,0,sizeof(zr));
+		memset(zi,0,sizeof(zi));
+		mandel_orbits(&x[i],&y[i],zr,zi,m,0,max,&iters[i]);
+	}
+}
+
+void mandel_row( const double *x, double y, int n, int max, int *iters )
+{
+	double ys[MANDEL_CHUNK];
+	int i;
+
+	for(i=0;i<MANDEL_CHUNK;i++) {
+		ys[i] = y;
+	}
+	for(i=0;i<n;i+=MANDEL_CHUNK) {
+		mandel_points(&x[i],ys,n-i < MANDEL_CHUNK ? n-i : MANDEL_CHUNK,max,&iters[i]);
+	}
+}
+
+const char *mandel_isa()
+{
+	return mandel_isa_name;
+}
@@ -0,0 +1,77 @@
+/*
+mandel.h - Shared Mandelbrot escape-time kernel
+Used by fractal.c, fractalthread.c and fractaltask.c.
+*/
+
+#ifndef MANDEL_H
+#define MANDEL_H
+
+/* Return the number of iterations at point x + iy, up to a maximum of max. */
+int mandel_point( double x, double y, int max );
+
+/*
+Compute the iterations of n points x[0..n-1] + iy that share one row,
+storing them in iters[0..n-1].  The results are the same as calling
+mandel_point on each point, but several points are iterated at once
+with the widest vector instructions the CPU supports.
+*/
+void mandel_row( const double *x, double y, int n, int max, int *iters );
+
+/* Compute the iterations of n points x[0..n-1] + iy[0..n-1] in any arrangement, as mandel_row does. */
+void mandel_points( const double *x, const double *y, int n, int max, int *iters );
+
+/*
+Continue the orbits of n points x[0..n-1] + iy[0..n-1] from iteration
+from up to max, as mandel_points does.  zr and zi hold z after from
+iterations on entry (0 for a fresh orbit), and the z each orbit ended
+with on return (see mandel_set_smooth for the ones that escaped), or
+NaN in zr for a point known to never escape.  An
+orbit that did not escape by one max can then be carried on to a
+higher one without repeating its first iterations, and the counts
+are the same as computing it afresh.
+*/
+void mandel_orbits( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters );
+
+/*
+The same, but iterating in single precision, which runs twice as many
+points per vector.  The points are rounded to floats, so this is only
+for pixels far larger than 1e-7, and the counts may differ from the
+double kernel near the boundary of the set.  Without a vector unit,
+or beyond MANDEL_FLOAT_MAXITER, it falls back to double precision.
+*/
+#define MANDEL_FLOAT_MAXITER (1<<24)
+void mandel_orbits_float( const double *x, const double *y, double *zr, double *zi, int n, int from, int max, int *iters );
+
+/*
+Turn the interior test on or off.  When it is on, points inside the
+main cardioid or the period-2 bulb, which never escape, return max at
+once instead of iterating max times.  It is on unless the environment
+sets MANDEL_INTERIOR=0.
+*/
+void mandel_set_interior( int enabled );
+
+/*
+Set the tolerance of the periodicity check, or turn it off with a
+negative tolerance.  A point whose orbit returns to within the
+tolerance (in |dx|+|dy|) of an earlier point is caught in a cycle
+and returns max.  With a tolerance of 0 only an exact repeat counts,
+which never changes a result.  The environment may set
+MANDEL_PERIODICITY to a tolerance, or to off.
+*/
+#define MANDEL_TOLERANCE 0
+void mandel_set_periodicity( double tolerance );
+
+/*
+Keep the z that each escaping orbit of mandel_orbits escaped with, for
+smooth coloring, which takes |z|^2 at the escape.  The vector kernels
+otherwise leave an escaped lane with wherever its z went on to while
+the rest of its group kept iterating.  Keeping it costs a few percent,
+and is on unless the environment sets MANDEL_SMOOTH=0.
+*/
+void mandel_set_smooth( int enabled );
+int mandel_smooth_enabled();
+
+/* Return the name of the instruction set used by mandel_row. */
+const char *mandel_isa();
+
+#endif
@@ -0,0 +1,99 @@
+/*
+mandel_kernel.h - One vector group kernel, written once for every
+instruction set and element type.
+
+mandel.c includes this file once per kernel, after defining:
+
+  KERNEL        the name of the function
+  TARGET        its target attribute, such as "avx2"
+  REAL          the element type, float or double, and SUFFIX
+                the matching intrinsic suffix, _ps or _pd
+  VEC           the vector type, MASK the type of a lane mask
+  LOAD ZERO SET1 ADD SUB MUL ABS
+                the arithmetic on VEC
+  ALL NONE      masks with every lane set, and with none
+  OR(m,c)       the lanes of either mask
+  LESS(m,a,b)   the lanes of m where a < b, and LESSEQ for a <= b
+  ANY(m)        nonzero if any lane of m is set
+  COUNT(c,m,o)  c + o in the lanes of m, c elsewhere
+  SELECT(c,m,v) v in the lanes of m, c elsewhere
+  CLEAR(m,c)    m without the lanes of c
+  STORE(p,c)    truncate the counts c to ints and store them at p
+
+Each lane performs exactly the same operations as the scalar loop in
+mandel_orbit, in the precision of REAL, starting from the z in zrs and
+zis after from iterations, and stores the z it ends with there, or with
+mandel_smooth the z it escaped with.  The per-kernel definitions
+are undone at the end, so the next kernel can define its own.
+*/
+
+__attribute__((target(TARGET)))
+static void KERNEL( const REAL *x, const REAL *y, REAL *zrs, REAL *zis, int from, int max, int *iters )
+{
+	VEC cr = LOAD(x);
+	VEC ci = LOAD(y);
+	VEC zr = LOAD(zrs), zi = LOAD(zis);
+	VEC zr2 = MUL(zr,zr), zi2 = MUL(zi,zi);
+	VEC count = SET1(from);
+	VEC one = SET1(1.0);
+	VEC limit = SET1(16.0);
+	MASK active = ALL;
+	MASK cycles = NONE;
+	VEC sr = zr, si = zi;
+	VEC tolerance = SET1(mandel_tolerance);
+	VEC maxcount = SET1(max);
+	int check = mandel_tolerance>=0;
+	int smooth = mandel_smooth;
+	int save = mandel_next_save(from);
+	int k;
+
+	VEC er = zr, ei = zi;
+	MASK escaped = NONE;
+	for(k=from;k<max;k++) {
+		MASK running = LESS(active,ADD(zr2,zi2),limit);
+		if(smooth) {
+			MASK now = CLEAR(active,running);
+			if(ANY(now)) {
+				er = SELECT(er,now,zr);
+				ei = SELECT(ei,now,zi);
+				escaped = OR(escaped,now);
+			}
+		}
+		active = running;
+		if(!ANY(active)) break;
+		zi = ADD(MUL(ADD(zr,zr),zi),ci);
+		zr = ADD(SUB(zr2,zi2),cr);
+		zr2 = MUL(zr,zr);
+		zi2 = MUL(zi,zi);
+		count = COUNT(count,active,one);
+
+		if(check) {
+			VEC d = ADD(ABS(SUB(zr,sr)),ABS(SUB(zi,si)));
+			MASK cycle = LESSEQ(active,d,tolerance);
+			count = SELECT(count,cycle,maxcount);
+			active = CLEAR(active,cycle);
+			cycles = OR(cycles,cycle);
+			if(k+1==save) {
+				sr = zr;
+				si = zi;
+				save *= 2;
+			}
+		}
+	}
+
+	// A lane caught in a cycle will never escape, which NaN records for a later resume
+	if(smooth) {
+		zr = SELECT(zr,escaped,er);
+		zi = SELECT(zi,escaped,ei);
+	}
+	STORE(iters,count);
+	V(storeu)(zrs,SELECT(zr,cycles,SET1(NAN)));
+	V(storeu)(zis,zi);
+}
+
+#undef KERNEL
+#undef REAL
+#undef SUFFIX
+#undef VEC
+#undef MASK
+#undef STORE
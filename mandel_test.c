@@ -0,0 +1,192 @@
+/*
+mandel_test.c - Check the escape-time kernels against plain loops
+make test runs it once for each instruction set that MANDEL_ISA can
+force, and fails if any check does.
+*/
+
+#include "mandel.h"
+#include "frame.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <complex.h>
+
+/*
+The views the kernels are checked on: the whole set, the seahorse
+valley, a view mostly inside the set, where the interior test and the
+cycle check do most of the work, and a deep zoom, whose neighboring
+points differ in the last bits.
+*/
+static const struct {
+	const char *name;
+	double xmin, xmax, ymin, ymax;
+	int maxiter;
+} test_views[] = {
+	{ "full", -2.5, 1, -1.3125, 1.3125, 2000 },
+	{ "seahorse", -0.8, -0.7, 0.05, 0.125, 2000 },
+	{ "interior", -0.4, 0, -0.15, 0.15, 2000 },
+	{ "deepzoom", -0.7436438870372, -0.7436438870370, 0.1318259042052, 0.13182590420535, 2000 },
+};
+
+#define TEST_WIDTH 200
+#define TEST_HEIGHT 150
+
+// The share of the counts that the float kernel may give differently than the double one
+#define FLOAT_TOLERANCE 0.01
+
+// The plain escape loop with an exact complex multiply, which mandel_point must match
+static int exact_point( double x, double y, int max )
+{
+	double complex z = 0;
+	double complex c = x + I*y;
+	int iter = 0;
+
+	while( creal(z)*creal(z) + cimag(z)*cimag(z) < 16 && iter < max ) {
+		z = z*z + c;
+		iter++;
+	}
+	return iter;
+}
+
+/*
+The loop the programs started from.  glibc computes cpow through clog
+and cexp, which round differently than a multiply, so it counts a few
+pixels on the boundary of the set differently, 42 of the default view
+with the glibc this was written with.  How many depends on the libm,
+so the count is only reported.
+*/
+static int cpow_point( double x, double y, int max )
+{
+	double complex z = 0;
+	double complex c = x + I*y;
+	int iter = 0;
+
+	while( cabs(z)<4 && iter < max ) {
+		z = cpow(z,2) + c;
+		iter++;
+	}
+	return iter;
+}
+
+// Compare mandel_point on the default view with the exact loop, and with the cpow loop
+static int check_point()
+{
+	int width = 640, height = 480, maxiter = 500;
+	double xmin = -1.5, xmax = 0.5, ymin = -1.0, ymax = 1.0;
+	int exact = 0, cpow = 0;
+	int i, j;
+
+	for(j=0;j<height;j++) {
+		for(i=0;i<width;i++) {
+			double x = xmin + i*(xmax-xmin)/width;
+			double y = ymin + j*(ymax-ymin)/height;
+			int iter = mandel_point(x,y,maxiter);
+			exact += iter != exact_point(x,y,maxiter);
+			cpow += iter != cpow_point(x,y,maxiter);
+		}
+	}
+
+	printf("point: %d differences from z*z (expected 0), %d from cpow (rounding, for information)\n", exact, cpow);
+	return exact == 0;
+}
+
+// Compare mandel_row and mandel_point with the exact loop on each view, with the cycle check on
+static int check_views()
+{
+	double x[TEST_WIDTH];
+	int iters[TEST_WIDTH];
+	unsigned int v;
+	int ok = 1;
+
+	mandel_set_periodicity(MANDEL_TOLERANCE);
+	for(v=0;v<sizeof(test_views)/sizeof(test_views[0]);v++) {
+		int rows = 0, points = 0;
+		int max = test_views[v].maxiter;
+		int i, j;
+
+		for(j=0;j<TEST_HEIGHT;j++) {
+			double y = test_views[v].ymin + j*(test_views[v].ymax-test_views[v].ymin)/TEST_HEIGHT;
+			for(i=0;i<TEST_WIDTH;i++) {
+				x[i] = test_views[v].xmin + i*(test_views[v].xmax-test_views[v].xmin)/TEST_WIDTH;
+			}
+			mandel_row(x,y,TEST_WIDTH,max,iters);
+			for(i=0;i<TEST_WIDTH;i++) {
+				int expected = exact_point(x[i],y,max);
+				rows += iters[i] != expected;
+				points += mandel_point(x[i],y,max) != expected;
+			}
+		}
+
+		printf("%s %s: %d differences in mandel_row, %d in mandel_point (expected 0)\n", mandel_isa(), test_views[v].name, rows, points);
+		ok = ok && rows == 0 && points == 0;
+	}
+	return ok;
+}
+
+// Count the pixels of a view that mandel_orbits_float gives different counts than mandel_orbits
+static int float_differences( double xmin, double xmax, double ymin, double ymax, int width, int height, int max )
+{
+	double x[width], y[width], zr[width], zi[width];
+	int single[width], twice[width];
+	int differences = 0;
+	int i, j;
+
+	for(j=0;j<height;j++) {
+		for(i=0;i<width;i++) {
+			x[i] = xmin + i*(xmax-xmin)/width;
+			y[i] = ymin + j*(ymax-ymin)/height;
+			zr[i] = zi[i] = 0;
+		}
+		mandel_orbits_float(x,y,zr,zi,width,0,max,single);
+		for(i=0;i<width;i++) {
+			zr[i] = zi[i] = 0;
+		}
+		mandel_orbits(x,y,zr,zi,width,0,max,twice);
+		for(i=0;i<width;i++) {
+			differences += single[i] != twice[i];
+		}
+	}
+	return differences;
+}
+
+/*
+Bound how many counts the float kernel changes on the views the
+programs draw in floats: the default view, and the sampled views with
+pixels of at least FRAME_FLOAT_PIXEL, at FRAME_FLOAT_MAXITER.  The
+orbits of points near the boundary part after enough iterations, so
+some counts always differ; they should stay a small share.
+*/
+static int check_float()
+{
+	int width = 640, height = 480;
+	int differences = float_differences(-1.5,0.5,-1.0,1.0,width,height,500);
+	int ok = differences <= FLOAT_TOLERANCE*width*height;
+	unsigned int v;
+
+	printf("%s float default: %d differences from double (%.2f%%)\n", mandel_isa(), differences, 100.0*differences/(width*height));
+	for(v=0;v<sizeof(test_views)/sizeof(test_views[0]);v++) {
+		if((test_views[v].xmax-test_views[v].xmin)/TEST_WIDTH < FRAME_FLOAT_PIXEL) {
+			continue;
+		}
+		differences = float_differences(test_views[v].xmin,test_views[v].xmax,test_views[v].ymin,test_views[v].ymax,TEST_WIDTH,TEST_HEIGHT,FRAME_FLOAT_MAXITER);
+		printf("%s float %s: %d differences from double (%.2f%%)\n", mandel_isa(), test_views[v].name, differences, 100.0*differences/(TEST_WIDTH*TEST_HEIGHT));
+		ok = ok && differences <= FLOAT_TOLERANCE*TEST_WIDTH*TEST_HEIGHT;
+	}
+	return ok;
+}
+
+int main( int argc, char *argv[] )
+{
+	int ok = 1;
+
+	// The cpow check does not depend on the instruction set, so it can be skipped
+	if(argc < 2 || strcmp(argv[1],"views")) {
+		ok = check_point() && ok;
+	}
+	ok = check_views() && ok;
+	ok = check_float() && ok;
+
+	printf("%s\n", ok ? "ok" : "FAILED");
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,318 @@
+/*
+palette.c - Colors for iteration counts
+*/
+
+#include "palette.h"
+#include "mandel.h"
+#include "gfx.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PALETTE_X86 1
+#endif
+
+/*
+Each palette ramps the count up to 255 at maxiter, times the scale,
+and multiplies the ramp by a factor per channel, keeping the low 8
+bits as gfx_rgb does, so a channel with a large factor cycles through
+its range many times.
+*/
+static const struct {
+	const char *name;
+	int r, g, b;
+} palette_schemes[PALETTE_SCHEMES] = {
+	{ "ember", 4, 1, 1 },
+	{ "steel", 5, 10, 15 },
+	{ "neon", 10, 20, 50 },
+	{ "gray", 1, 1, 1 },
+};
+
+typedef void (*palette_map_func)( const unsigned int *lut, int maxiter, const int *iters, unsigned int *pixels, int n );
+
+static void palette_map_scalar( const unsigned int *lut, int maxiter, const int *iters, unsigned int *pixels, int n )
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		unsigned int iter = iters[i];
+		pixels[i] = lut[iter < (unsigned) maxiter ? iter : (unsigned) maxiter];
+	}
+}
+
+#ifdef PALETTE_X86
+
+// Clamping the counts as unsigned also sends any negative count to maxiter
+__attribute__((target("avx2")))
+static void palette_map_avx2( const unsigned int *lut, int maxiter, const int *iters, unsigned int *pixels, int n )
+{
+	__m256i max = _mm256_set1_epi32(maxiter);
+	int i;
+
+	for (i=0; i+8<=n; i+=8) {
+		__m256i iter = _mm256_min_epu32(_mm256_loadu_si256((const __m256i *) &iters[i]), max);
+		_mm256_storeu_si256((__m256i *) &pixels[i], _mm256_i32gather_epi32((const int *) lut, iter, 4));
+	}
+	palette_map_scalar(lut, maxiter, iters+i, pixels+i, n-i);
+}
+
+__attribute__((target("avx512f")))
+static void palette_map_avx512( const unsigned int *lut, int maxiter, const int *iters, unsigned int *pixels, int n )
+{
+	__m512i max = _mm512_set1_epi32(maxiter);
+	int i;
+
+	for (i=0; i+16<=n; i+=16) {
+		__m512i iter = _mm512_min_epu32(_mm512_loadu_si512(&iters[i]), max);
+		_mm512_storeu_si512(&pixels[i], _mm512_i32gather_epi32(iter, lut, 4));
+	}
+	palette_map_scalar(lut, maxiter, iters+i, pixels+i, n-i);
+}
+
+#endif
+
+static palette_map_func palette_mapper = palette_map_scalar;
+
+// Gather with the instruction set mandel.c picked, so MANDEL_ISA applies to both
+static void palette_select_isa()
+{
+#ifdef PALETTE_X86
+	if (!strcmp(mandel_isa(), "avx512")) {
+		palette_mapper = palette_map_avx512;
+	} else if (!strcmp(mandel_isa(), "avx2")) {
+		palette_mapper = palette_map_avx2;
+	}
+#endif
+}
+
+void palette_init( palette *p, int scheme )
+{
+	memset(p, 0, sizeof(palette));
+	p->scheme = scheme % PALETTE_SCHEMES;
+	p->scale = 1;
+	p->maxiter = -1;
+	palette_select_isa();
+}
+
+void palette_next_scheme( palette *p )
+{
+	p->scheme = (p->scheme+1) % PALETTE_SCHEMES;
+	p->maxiter = -1;
+}
+
+void palette_next_scale( palette *p )
+{
+	p->scale = p->scale < 1<<(PALETTE_SCALES-1) ? 2*p->scale : 1;
+	p->maxiter = -1;
+}
+
+void palette_toggle_smooth( palette *p )
+{
+	p->smooth = !p->smooth;
+}
+
+void palette_toggle_equalize( palette *p )
+{
+	p->equalize = !p->equalize;
+	p->maxiter = -1;
+}
+
+void palette_print( const palette *p )
+{
+	printf("palette: %s %dx%s%s\n", palette_schemes[p->scheme].name, p->scale, p->smooth ? " smooth" : "", p->equalize ? " equalized" : "");
+}
+
+// The color of a place on the ramp
+static unsigned int palette_rgb( const palette *p, double ramp )
+{
+	return gfx_rgb(ramp*palette_schemes[p->scheme].r, ramp*palette_schemes[p->scheme].g, ramp*palette_schemes[p->scheme].b);
+}
+
+static void palette_reserve( palette *p, int maxiter )
+{
+	if (maxiter+2 > p->capacity) {
+		free(p->lut);
+		free(p->ramp);
+		p->capacity = maxiter+2;
+		p->lut = (unsigned int *) malloc (p->capacity*sizeof(unsigned int));
+		p->ramp = (float *) malloc (p->capacity*sizeof(float));
+		if (!p->lut || !p->ramp) {
+			fprintf(stderr, "palette_build: out of memory.\n");
+			exit(1);
+		}
+	}
+}
+
+void palette_build( palette *p, int maxiter )
+{
+	int iter;
+
+	if (maxiter == p->maxiter) {
+		return;
+	}
+	palette_reserve(p, maxiter);
+
+	// The table colors whole steps of the ramp, as the engines always have
+	for (iter=0; iter<=maxiter; iter++) {
+		int ramp = 255LL * iter * p->scale / maxiter;
+		p->ramp[iter] = 255.0 * iter * p->scale / maxiter;
+		p->lut[iter] = palette_rgb(p, ramp);
+	}
+	p->ramp[maxiter+1] = p->ramp[maxiter];
+	p->maxiter = maxiter;
+}
+
+static void palette_map_smooth( const palette *p, const int *iters, const float *fracs, unsigned int *pixels, int n )
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		pixels[i] = palette_color(p, iters[i], fracs[i]);
+	}
+}
+
+void palette_map( const palette *p, const int *iters, const float *fracs, unsigned int *pixels, int n )
+{
+	if (p->smooth) {
+		palette_map_smooth(p, iters, fracs, pixels, n);
+	} else {
+		palette_mapper(p->lut, p->maxiter, iters, pixels, n);
+	}
+}
+
+unsigned int palette_color( const palette *p, int iter, float frac )
+{
+	unsigned int k = (unsigned) iter < (unsigned) p->maxiter ? iter : p->maxiter;
+
+	if (!p->smooth) {
+		return p->lut[k];
+	}
+	return palette_rgb(p, p->ramp[k] + frac*(p->ramp[k+1]-p->ramp[k]));
+}
+
+void palette_pass_begin( palette_pass *s, palette *p, const int *iters, const float *fracs, unsigned int *pixels, int n, int maxiter, int num_bands )
+{
+	int i;
+
+	s->palette = p;
+	s->iters = iters;
+	s->fracs = fracs;
+	s->pixels = pixels;
+	s->n = n;
+	s->maxiter = maxiter;
+	s->num_bands = num_bands;
+
+	if (num_bands > s->band_capacity) {
+		free(s->bands);
+		s->band_capacity = num_bands;
+		s->bands = (palette_band *) malloc (num_bands*sizeof(palette_band));
+		if (!s->bands) {
+			fprintf(stderr, "palette_pass_begin: out of memory.\n");
+			exit(1);
+		}
+	}
+	for (i=0; i<num_bands; i++) {
+		s->bands[i].pass = s;
+		s->bands[i].band = i;
+	}
+
+	if (p->equalize && (long) num_bands*(maxiter+1) > s->hist_capacity) {
+		free(s->hists);
+		s->hist_capacity = (long) num_bands*(maxiter+1);
+		s->hists = (unsigned int *) malloc (s->hist_capacity*sizeof(unsigned int));
+		if (!s->hists) {
+			fprintf(stderr, "palette_pass_begin: out of memory.\n");
+			exit(1);
+		}
+	}
+	palette_build(p, maxiter);
+}
+
+void *palette_count_band( void *band )
+{
+	palette_band *b = (palette_band *) band;
+	palette_pass *s = b->pass;
+	unsigned int *hist = &s->hists[(long) b->band*(s->maxiter+1)];
+	int first = (long) b->band*s->n/s->num_bands, last = (long) (b->band+1)*s->n/s->num_bands;
+	int i;
+
+	memset(hist, 0, (s->maxiter+1)*sizeof(unsigned int));
+	for (i=first; i<last; i++) {
+		unsigned int iter = s->iters[i];
+		hist[iter < (unsigned) s->maxiter ? iter : (unsigned) s->maxiter]++;
+	}
+	return 0;
+}
+
+// Add the share of the bins of this band from every histogram into the first
+void *palette_merge_band( void *band )
+{
+	palette_band *b = (palette_band *) band;
+	palette_pass *s = b->pass;
+	long bins = s->maxiter+1;
+	long first = b->band*bins/s->num_bands, last = (b->band+1)*bins/s->num_bands;
+	long i;
+	int k;
+
+	for (k=1; k<s->num_bands; k++) {
+		const unsigned int *hist = &s->hists[k*bins];
+		for (i=first; i<last; i++) {
+			s->hists[i] += hist[i];
+		}
+	}
+	return 0;
+}
+
+void palette_equalize( palette_pass *s )
+{
+	palette *p = s->palette;
+	int maxiter = s->maxiter;
+	double escaped = 0, below = 0;
+	int iter;
+
+	palette_reserve(p, maxiter);
+	for (iter=0; iter<maxiter; iter++) {
+		escaped += s->hists[iter];
+	}
+
+	// Each count starts where the pixels with lower counts leave off
+	for (iter=0; iter<=maxiter; iter++) {
+		double ramp = iter < maxiter && escaped > 0 ? 255.0 * p->scale * below / escaped : 255.0 * p->scale;
+		p->ramp[iter] = ramp;
+		p->lut[iter] = palette_rgb(p, (int) ramp);
+		below += s->hists[iter];
+	}
+	p->ramp[maxiter+1] = p->ramp[maxiter];
+	p->maxiter = maxiter;
+}
+
+void *palette_map_band( void *band )
+{
+	palette_band *b = (palette_band *) band;
+	palette_pass *s = b->pass;
+	int first = (long) b->band*s->n/s->num_bands, last = (long) (b->band+1)*s->n/s->num_bands;
+
+	palette_map(s->palette, &s->iters[first], &s->fracs[first], &s->pixels[first], last-first);
+	return 0;
+}
+
+void palette_pass_run( palette_pass *s )
+{
+	int i;
+
+	if (s->palette->equalize) {
+		for (i=0; i<s->num_bands; i++) {
+			palette_count_band(&s->bands[i]);
+		}
+		for (i=0; i<s->num_bands; i++) {
+			palette_merge_band(&s->bands[i]);
+		}
+		palette_equalize(s);
+	}
+	for (i=0; i<s->num_bands; i++) {
+		palette_map_band(&s->bands[i]);
+	}
+}
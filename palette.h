@@ -0,0 +1,125 @@
+/*
+palette.h - Colors for iteration counts
+The engines keep the iteration count of every pixel, and a palette
+turns counts into pixels through a table built once per maxiter, so
+choosing another palette or color scale only maps the counts already
+computed again, without computing any of them.
+*/
+
+#ifndef PALETTE_H
+#define PALETTE_H
+
+/* The number of palettes, and of color scales (1x, 2x, 4x and 8x) */
+#define PALETTE_SCHEMES 4
+#define PALETTE_SCALES 4
+
+/*
+Each count has a place on a ramp from 0 to 255 times the scale, which
+the palette turns into a color.  The ramp climbs evenly up to maxiter,
+or when equalizing, by the share of the escaped pixels of the frame
+with a lower count, which spreads the colors evenly over the pixels
+whatever the zoom.  lut holds the color of every count 0..maxiter and
+ramp its place, with one more entry repeating maxiter's.  In smooth
+mode a pixel goes a fraction of the way from its count's place to the
+next one's, which takes the bands out of the image.
+*/
+typedef struct {
+	int scheme;
+	int scale;
+	int smooth;
+	int equalize;
+	int maxiter;
+	unsigned int *lut;
+	float *ramp;
+	int capacity;
+} palette;
+
+/*
+Set up palette number scheme at scale 1x, without a table yet.
+Palettes 0, 1 and 2 are the colors of fractal, fractalthread and
+fractaltask.
+*/
+void palette_init( palette *p, int scheme );
+
+/* Move on to the next palette, or the next color scale, wrapping around. */
+void palette_next_scheme( palette *p );
+void palette_next_scale( palette *p );
+
+/* Turn smooth coloring, or histogram equalization, on or off. */
+void palette_toggle_smooth( palette *p );
+void palette_toggle_equalize( palette *p );
+
+/* Print the palette and scale in use. */
+void palette_print( const palette *p );
+
+/*
+Make sure the table holds the colors of every count 0..maxiter,
+building the even ramp again if maxiter, the palette or the scale has
+changed.  An equalized table of the same maxiter is kept, to color the
+next frame until it is equalized in turn.  Call it before mapping any
+counts of a frame, from one thread.
+*/
+void palette_build( palette *p, int maxiter );
+
+/*
+Color the n counts iters[0..n-1] into pixels[0..n-1], looking them up
+in the table with vector gathers where the CPU has them.  fracs holds
+the fractions of the counts, which only smooth mode uses.  Counts above
+maxiter get the color of maxiter.  Any number of threads may map
+counts at once.
+*/
+void palette_map( const palette *p, const int *iters, const float *fracs, unsigned int *pixels, int n );
+
+/* Return the color of a single count and its fraction. */
+unsigned int palette_color( const palette *p, int iter, float frac );
+
+/*
+A pass colors a whole frame from its counts, split into bands that
+threads run at the same time, in up to three steps with a wait after
+each.  palette_count_band makes a histogram of the counts of each band,
+and palette_merge_band adds up the histograms over each band's share of
+the bins, so neither step has a serial part that grows with the image.
+palette_equalize then builds the table from the merged histogram, from
+one thread, in time proportional to maxiter.  Last, palette_map_band
+colors each band.  The first three steps are only for equalizing.
+
+The steps take a palette_band, so that they can be passed straight to
+pool_submit with the bands array.
+*/
+typedef struct palette_pass palette_pass;
+
+typedef struct {
+	palette_pass *pass;
+	int band;
+} palette_band;
+
+struct palette_pass {
+	palette *palette;
+	const int *iters;
+	const float *fracs;
+	unsigned int *pixels;
+	int n;
+	int maxiter;
+	int num_bands;
+	palette_band *bands;
+	unsigned int *hists;
+	int band_capacity;
+	long hist_capacity;
+};
+
+/*
+Get a pass ready to color the n pixels of a frame of maxiter from its
+counts and their fractions, in num_bands bands.  The pass keeps its
+memory from one frame to the next.
+*/
+void palette_pass_begin( palette_pass *s, palette *p, const int *iters, const float *fracs, unsigned int *pixels, int n, int maxiter, int num_bands );
+
+void *palette_count_band( void *band );
+void *palette_merge_band( void *band );
+void palette_equalize( palette_pass *s );
+void *palette_map_band( void *band );
+
+/* Run every step of the pass on the calling thread. */
+void palette_pass_run( palette_pass *s );
+
+#endif
@@ -0,0 +1,192 @@
+/*
+pool.c - Persistent pool of worker threads
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+typedef struct {
+	pool *p; 
+	int id; 
+	int generation; 
+} pool_worker; 
+
+struct pool {
+	pthread_mutex_t lock; 
+	pthread_cond_t work; 
+	pthread_cond_t done; 
+	pthread_t *threads; 
+	pool_worker **workers; 
+	int num_threads; 
+	int generation; 
+	int active; 
+	int running; 
+	int shutdown; 
+	void *(*func)(void *); 
+	char *args; 
+	size_t size; 
+}; 
+
+/*
+Each worker sleeps until the generation number changes, which means a new
+frame was submitted.  Workers numbered below active run their share of it,
+and the last one to finish wakes up pool_wait.
+*/
+
+static void * pool_main( void *arg )
+{
+	pool_worker *w = (pool_worker *) arg; 
+	pool *p = w->p; 
+
+	pthread_mutex_lock(&p->lock); 
+	while (1) {
+		while (w->generation == p->generation && !p->shutdown) {
+			pthread_cond_wait(&p->work, &p->lock); 
+		}
+		if (p->shutdown) {
+			break; 
+		}
+		w->generation = p->generation; 
+
+		if (w->id < p->active) {
+			void *(*func)(void *) = p->func; 
+			void *args = p->args + w->id*p->size; 
+
+			pthread_mutex_unlock(&p->lock); 
+			func(args); 
+			pthread_mutex_lock(&p->lock); 
+
+			if (--p->running == 0) {
+				pthread_cond_broadcast(&p->done); 
+			}
+		}
+	}
+	pthread_mutex_unlock(&p->lock); 
+
+	return NULL; 
+}
+
+// Add threads until there are num_threads.  Called with the lock held.
+static void pool_grow( pool *p, int num_threads )
+{
+	int i; 
+
+	if (num_threads <= p->num_threads) {
+		return; 
+	}
+
+	// Each worker keeps a pointer to its own record, so records are allocated one by one.
+	pthread_t *threads = (pthread_t *) realloc (p->threads, num_threads*sizeof(pthread_t)); 
+	pool_worker **workers = (pool_worker **) realloc (p->workers, num_threads*sizeof(pool_worker *)); 
+	if (!threads || !workers) {
+		fprintf(stderr, "pool_grow: out of memory.\n"); 
+		exit(1); 
+	}
+	p->threads = threads; 
+	p->workers = workers; 
+
+	for (i = p->num_threads; i < num_threads; i++) {
+		pool_worker *w = (pool_worker *) malloc (sizeof(pool_worker)); 
+		if (!w) {
+			fprintf(stderr, "pool_grow: out of memory.\n"); 
+			exit(1); 
+		}
+		w->p = p; 
+		w->id = i; 
+		w->generation = p->generation; 
+		p->workers[i] = w; 
+		if (pthread_create(&p->threads[i], NULL, pool_main, w) != 0) {
+			fprintf(stderr, "pool_grow: unable to create thread.\n"); 
+			exit(1); 
+		}
+	}
+
+	p->num_threads = num_threads; 
+}
+
+pool * pool_create( int num_threads )
+{
+	pool *p = (pool *) calloc (1, sizeof(pool)); 
+	if (!p) {
+		fprintf(stderr, "pool_create: out of memory.\n"); 
+		exit(1); 
+	}
+
+	pthread_mutex_init(&p->lock, NULL); 
+	pthread_cond_init(&p->work, NULL); 
+	pthread_cond_init(&p->done, NULL); 
+
+	pthread_mutex_lock(&p->lock); 
+	pool_grow(p, num_threads); 
+	pthread_mutex_unlock(&p->lock); 
+
+	return p; 
+}
+
+void pool_submit( pool *p, int num_workers, void *(*func)(void *), void *args, size_t size )
+{
+	pthread_mutex_lock(&p->lock); 
+	pool_grow(p, num_workers); 
+	p->func = func; 
+	p->args = (char *) args; 
+	p->size = size; 
+	p->active = num_workers; 
+	p->running = num_workers; 
+	p->generation++; 
+	pthread_cond_broadcast(&p->work); 
+	pthread_mutex_unlock(&p->lock); 
+}
+
+void pool_wait( pool *p )
+{
+	pthread_mutex_lock(&p->lock); 
+	while (p->running > 0) {
+		pthread_cond_wait(&p->done, &p->lock); 
+	}
+	pthread_mutex_unlock(&p->lock); 
+}
+
+int pool_finished( pool *p )
+{
+	int finished; 
+
+	pthread_mutex_lock(&p->lock); 
+	finished = p->running == 0; 
+	pthread_mutex_unlock(&p->lock); 
+
+	return finished; 
+}
+
+void pool_destroy( pool *p )
+{
+	int i; 
+
+	pthread_mutex_lock(&p->lock); 
+	p->shutdown = 1; 
+	pthread_cond_broadcast(&p->work); 
+	pthread_mutex_unlock(&p->lock); 
+
+	for (i = 0; i < p->num_threads; i++) {
+		pthread_join(p->threads[i], NULL); 
+		free(p->workers[i]); 
+	}
+
+	free(p->threads); 
+	free(p->workers); 
+	pthread_mutex_destroy(&p->lock); 
+	pthread_cond_destroy(&p->work); 
+	pthread_cond_destroy(&p->done); 
+	free(p); 
+}
+
+int pool_nproc()
+{
+	long n = sysconf(_SC_NPROCESSORS_ONLN); 
+	return n > 0 ? (int) n : 1; 
+}
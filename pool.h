@@ -0,0 +1,36 @@
+/*
+pool.h - Persistent pool of worker threads
+The threads are created once and then reused for every frame,
+so a frame costs a wakeup instead of a pthread_create and join.
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+typedef struct pool pool; 
+
+/* Create a pool with num_threads idle workers. */
+pool * pool_create( int num_threads );
+
+/*
+Start a frame: worker i runs func(args + i*size) for i = 0..num_workers-1,
+just like pthread_create on each element of an array of thread arguments.
+The pool grows if it has fewer than num_workers threads.  Returns at once.
+*/
+void pool_submit( pool *p, int num_workers, void *(*func)(void *), void *args, size_t size );
+
+/* Wait until every worker of the current frame has returned. */
+void pool_wait( pool *p );
+
+/* Return 1 if every worker of the current frame has returned, without waiting. */
+int pool_finished( pool *p );
+
+/* Stop and join all the workers, then free the pool. */
+void pool_destroy( pool *p );
+
+/* Return the number of online processors, for a default pool size. */
+int pool_nproc();
+
+#endif
@@ -0,0 +1,78 @@
+/*
+rectqueue.c - Lock-free queue of rectangles to show
+
+This is Dmitry Vyukov's bounded queue, with a single consumer.  Every
+slot carries a sequence number, which says whether it is free for the
+producer holding ticket pos (seq == pos) or holds a rectangle for the
+consumer (seq == pos + 1).  Producers claim a ticket with a CAS on the
+tail, fill the slot, and publish it by storing its sequence number,
+so a producer that is slow to fill its slot never stops the others
+from pushing, only the consumer from getting past that slot.
+*/
+
+#include "rectqueue.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+
+void rectqueue_init( rectqueue *q, long capacity )
+{
+	long i; 
+
+	q->head = 0; 
+	q->tail = 0; 
+	q->capacity = capacity; 
+	q->slots = (rect_slot *) calloc (capacity, sizeof(rect_slot)); 
+	if (!q->slots) {
+		fprintf(stderr, "rectqueue_init: out of memory.\n"); 
+		exit(1); 
+	}
+	for (i=0; i<capacity; i++) {
+		q->slots[i].seq = i; 
+	}
+}
+
+void rectqueue_free( rectqueue *q )
+{
+	free(q->slots); 
+	q->slots = 0; 
+}
+
+int rectqueue_push( rectqueue *q, const rect *r )
+{
+	long pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED); 
+	rect_slot *slot; 
+
+	while (1) {
+		slot = &q->slots[pos & (q->capacity-1)]; 
+		long seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE); 
+		if (seq == pos) {
+			if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break; 
+			}
+		} else if (seq < pos) {
+			// The consumer has not emptied this slot since the last lap
+			return 0; 
+		} else {
+			pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED); 
+		}
+	}
+
+	slot->r = *r; 
+	__atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE); 
+	return 1; 
+}
+
+int rectqueue_pop( rectqueue *q, rect *r )
+{
+	long pos = q->head; 
+	rect_slot *slot = &q->slots[pos & (q->capacity-1)]; 
+
+	if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != pos + 1) {
+		return 0; 
+	}
+	*r = slot->r; 
+	__atomic_store_n(&slot->seq, pos + q->capacity, __ATOMIC_RELEASE); 
+	q->head = pos + 1; 
+	return 1; 
+}
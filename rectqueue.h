@@ -0,0 +1,52 @@
+/*
+rectqueue.h - Lock-free queue of rectangles to show
+Any number of worker threads push the rectangles of the framebuffer
+they have finished, and the one thread that owns the display pops
+them to draw, without a lock on either side.
+*/
+
+#ifndef RECTQUEUE_H
+#define RECTQUEUE_H
+
+/*
+A rectangle to copy from the framebuffer to the window, or with fill
+set, to fill with color, which the worker has also written into the
+framebuffer.  epoch tells which frame it was pushed for.
+*/
+typedef struct {
+	int x; 
+	int y; 
+	int w; 
+	int h; 
+	int fill; 
+	unsigned int color; 
+	int epoch; 
+} rect; 
+
+typedef struct {
+	rect r; 
+	long seq; 
+} rect_slot; 
+
+typedef struct {
+	long head; 
+	char pad[64-sizeof(long)]; 
+	long tail; 
+	char pad2[64-sizeof(long)]; 
+	long capacity; 
+	rect_slot *slots; 
+} rectqueue; 
+
+/* Create an empty queue that holds up to capacity rectangles, a power of two. */
+void rectqueue_init( rectqueue *q, long capacity );
+
+/* Free the memory of the queue. */
+void rectqueue_free( rectqueue *q );
+
+/* Add a rectangle from any thread.  Return 0, without waiting, if the queue is full. */
+int rectqueue_push( rectqueue *q, const rect *r );
+
+/* Take the oldest rectangle, or return 0 if there is none.  Only one thread may call this. */
+int rectqueue_pop( rectqueue *q, rect *r );
+
+#endif
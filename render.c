@@ -0,0 +1,226 @@
+/*
+render.c - Command line options and image output
+*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "render.h"
+
+#include <png.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+
+static void usage( const char *name )
+{
+	fprintf(stderr, "usage: %s [-o file.png|file.ppm] [-s WIDTHxHEIGHT] [-v xmin,xmax,ymin,ymax] [-c xcenter,ycenter,width] [-m maxiter] [-t threads] [-T tile_size] [-M] [-C cache_mb] [threads]\n", name); 
+	exit(1); 
+}
+
+// Parse a positive integer that makes up the whole string
+static int positive( const char *s, int *value )
+{
+	char *end; 
+	long v = strtol(s, &end, 10); 
+
+	if (end == s || *end || v < 1 || v > 1000000000) return 0; 
+	*value = v; 
+	return 1; 
+}
+
+// Parse xcenter,ycenter,width, with the center to the full precision of the view
+static int parse_center( const char *s, viewport *view )
+{
+	view_real x, y; 
+	char *end; 
+	int n; 
+
+	if (!(n = view_parse_real(s, &x)) || s[n] != ',') return 0; 
+	s += n+1; 
+	if (!(n = view_parse_real(s, &y)) || s[n] != ',') return 0; 
+	s += n+1; 
+
+	double scale = strtod(s, &end); 
+	if (end == s || *end || !(scale > 0)) return 0; 
+
+	view_set_center(view, x, y, scale); 
+	return 1; 
+}
+
+void render_parse( int argc, char *argv[], render_options *opts )
+{
+	int c; 
+	char extra; 
+	double xmin, xmax, ymin, ymax; 
+
+	while ((c = getopt(argc, argv, "o:s:v:c:m:t:T:MC:")) != -1) {
+		switch (c) {
+			case 'o':
+				opts->output = optarg; 
+				break; 
+			case 's':
+				if (sscanf(optarg, "%dx%d%c", &opts->width, &opts->height, &extra) != 2 
+				    || opts->width < 1 || opts->height < 1 || opts->width > RENDER_MAX_SIZE || opts->height > RENDER_MAX_SIZE) {
+					usage(argv[0]); 
+				}
+				break; 
+			case 'v':
+				if (sscanf(optarg, "%lf,%lf,%lf,%lf%c", &xmin, &xmax, &ymin, &ymax, &extra) != 4 
+				    || !(xmin < xmax) || !(ymin < ymax)) {
+					usage(argv[0]); 
+				}
+				view_init(&opts->view, xmin, xmax, ymin, ymax, opts->view.maxiter); 
+				break; 
+			case 'c':
+				if (!parse_center(optarg, &opts->view)) usage(argv[0]); 
+				break; 
+			case 'm':
+				if (!positive(optarg, &opts->view.maxiter) || opts->view.maxiter > VIEW_MAX_ITER) usage(argv[0]); 
+				break; 
+			case 't':
+				if (!positive(optarg, &opts->threads) || opts->threads > RENDER_MAX_THREADS) usage(argv[0]); 
+				break; 
+			case 'T':
+				if (!strcmp(optarg, "0")) {
+					opts->tile_size = 0; 
+				} else if (!positive(optarg, &opts->tile_size) || opts->tile_size > RENDER_MAX_SIZE) {
+					usage(argv[0]); 
+				}
+				break; 
+			case 'M':
+				opts->subdivide = 1; 
+				break; 
+			case 'C':
+				if (!strcmp(optarg, "0")) {
+					opts->cache_mb = 0; 
+				} else if (!positive(optarg, &opts->cache_mb) || opts->cache_mb > 1000000) {
+					usage(argv[0]); 
+				}
+				break; 
+			default:
+				usage(argv[0]); 
+		}
+	}
+
+	// The thread count may also be given on its own, as before
+	if (optind < argc) {
+		if (optind != argc-1 || !positive(argv[optind], &opts->threads) || opts->threads > RENDER_MAX_THREADS) usage(argv[0]); 
+	}
+}
+
+static int write_ppm( FILE *file, const unsigned int *pixels, int width, int height )
+{
+	int i, j; 
+	unsigned char *row = malloc(3*width); 
+
+	if (!row) return -1; 
+
+	fprintf(file, "P6\n%d %d\n255\n", width, height); 
+	for (j = 0; j < height; j++) {
+		for (i = 0; i < width; i++) {
+			unsigned int p = pixels[j*width+i]; 
+			row[3*i] = (p>>16) & 0xff; 
+			row[3*i+1] = (p>>8) & 0xff; 
+			row[3*i+2] = p & 0xff; 
+		}
+		if (fwrite(row, 3, width, file) != (size_t) width) break; 
+	}
+
+	free(row); 
+	return j == height ? 0 : -1; 
+}
+
+static int write_png( FILE *file, const unsigned int *pixels, int width, int height )
+{
+	int j; 
+	unsigned char *row = malloc(3*width); 
+	png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, 0, 0, 0); 
+	png_infop info = png ? png_create_info_struct(png) : 0; 
+
+	if (!row || !info) {
+		png_destroy_write_struct(&png, 0); 
+		free(row); 
+		return -1; 
+	}
+
+	// libpng reports errors by jumping back here
+	if (setjmp(png_jmpbuf(png))) {
+		png_destroy_write_struct(&png, &info); 
+		free(row); 
+		return -1; 
+	}
+
+	png_init_io(png, file); 
+	png_set_IHDR(png, info, width, height, 8, PNG_COLOR_TYPE_RGB, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT); 
+	png_write_info(png, info); 
+
+	for (j = 0; j < height; j++) {
+		const unsigned int *p = &pixels[j*width]; 
+		int i; 
+		for (i = 0; i < width; i++) {
+			row[3*i] = (p[i]>>16) & 0xff; 
+			row[3*i+1] = (p[i]>>8) & 0xff; 
+			row[3*i+2] = p[i] & 0xff; 
+		}
+		png_write_row(png, row); 
+	}
+	png_write_end(png, 0); 
+
+	png_destroy_write_struct(&png, &info); 
+	free(row); 
+	return 0; 
+}
+
+int render_write( const char *path, const unsigned int *pixels, int width, int height )
+{
+	size_t len = strlen(path); 
+	int result; 
+
+	FILE *file = fopen(path, "wb"); 
+	if (!file) {
+		fprintf(stderr, "render_write: %s: %s\n", path, strerror(errno)); 
+		return -1; 
+	}
+
+	if (len >= 4 && !strcmp(path+len-4, ".png")) {
+		result = write_png(file, pixels, width, height); 
+	} else {
+		result = write_ppm(file, pixels, width, height); 
+	}
+
+	if (fclose(file) != 0) result = -1; 
+	if (result < 0) {
+		fprintf(stderr, "render_write: %s: unable to write the image.\n", path); 
+	}
+	return result; 
+}
+
+double render_time()
+{
+	struct timespec ts; 
+	clock_gettime(CLOCK_MONOTONIC, &ts); 
+	return ts.tv_sec + ts.tv_nsec/1e9; 
+}
+
+void render_report( const int *iters, int width, int height, double seconds )
+{
+	int i; 
+	long long total = 0; 
+	unsigned int hash = 2166136261u; 
+
+	// FNV-1a over the counts, which are the same on every machine
+	for (i = 0; i < width*height; i++) {
+		unsigned int v = iters[i]; 
+		total += v; 
+		hash = (hash ^ (v & 0xff)) * 16777619u; 
+		hash = (hash ^ ((v >> 8) & 0xff)) * 16777619u; 
+		hash = (hash ^ ((v >> 16) & 0xff)) * 16777619u; 
+		hash = (hash ^ (v >> 24)) * 16777619u; 
+	}
+
+	printf("render: %d %d %.6f %lld %08x\n", width, height, seconds, total, hash); 
+}
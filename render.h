@@ -0,0 +1,75 @@
+/*
+render.h - Command line options and image output
+With -o, the front ends draw a single frame into memory with no
+X display and write it to a PNG or PPM file, so they can be used
+for batch rendering on machines without an X server.
+*/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "view.h"
+
+/*
+The widest and tallest image -s takes.  Pixel counts and the bytes of
+the framebuffer of the largest image, 4 bytes a pixel, then fit in an
+int, which is what the engines index them with.
+*/
+#define RENDER_MAX_SIZE 16384
+
+/*
+The most threads -t takes.  Each one has its own stack, deque and
+statistics, so a mistyped count would run out of memory.
+*/
+#define RENDER_MAX_THREADS 1024
+
+typedef struct {
+	const char *output; 
+	int width; 
+	int height; 
+	viewport view; 
+	int threads; 
+	int tile_size; 
+	int subdivide; 
+	int cache_mb; 
+} render_options; 
+
+/*
+Parse the command line into opts, which holds the defaults on entry:
+
+  [-o file.png|file.ppm] [-s WIDTHxHEIGHT] [-v xmin,xmax,ymin,ymax]
+  [-c xcenter,ycenter,width] [-m maxiter] [-t threads] [-T tile_size] [-M]
+  [-C cache_mb] [threads]
+
+-c gives the center to full precision, in the form view_print writes,
+for deep zooms.  -m takes at most VIEW_MAX_ITER, -s and -T at most
+RENDER_MAX_SIZE on either side, and -t at most RENDER_MAX_THREADS.  -T (the tile size, 0 to adapt it),
+-M (Mariani-Silver subdivision) and -C (the size of the tile cache in
+megabytes, 0 to turn it off) only apply to fractaltask.
+
+Prints the usage and exits if the command line is not valid.
+*/
+void render_parse( int argc, char *argv[], render_options *opts );
+
+/*
+Write width by height framebuffer pixels to path, as PNG if the
+name ends in .png and as binary PPM otherwise.  Returns 0 on success,
+or prints the reason and returns -1.
+*/
+int render_write( const char *path, const unsigned int *pixels, int width, int height );
+
+/* Return the time in seconds from an arbitrary starting point. */
+double render_time();
+
+/*
+Print one line about a frame written with -o, for the benchmark:
+
+  render: width height seconds iterations checksum
+
+iterations is the sum of the iteration counts of every pixel, and
+checksum a hash of the counts, so every engine that computes the same
+image prints the same checksum whatever its colors.
+*/
+void render_report( const int *iters, int width, int height, double seconds );
+
+#endif
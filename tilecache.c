@@ -0,0 +1,202 @@
+/*
+tilecache.c - Least recently used cache of iteration-count tiles
+*/
+
+#include "tilecache.h"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+The tiles are chained in a hash table for lookup, and in a doubly
+linked list from the most to the least recently used, which is the
+first to go when the cache is over budget.  The counts, and then the
+fractions of the counts, follow each entry in the same allocation.
+*/
+struct tile_entry {
+	tile_key key;
+	tile_entry *next_in_bucket;
+	tile_entry *newer;
+	tile_entry *older;
+	size_t bytes;
+	int iters[];
+};
+
+void tilecache_init( tilecache *c, size_t budget )
+{
+	memset(c, 0, sizeof(tilecache));
+	c->budget = budget;
+}
+
+// Round x to the nearest whole number, the same way for either sign
+static tile_coord quantize( view_real x )
+{
+	view_real q = x * TILECACHE_QUANTUM;
+	tile_coord t = (tile_coord) q;
+	if (q - t >= 0.5) t++;
+	if (q - t < -0.5) t--;
+	return t;
+}
+
+void tilecache_key( tile_key *k, const viewport *v, int width, int height, int x, int y, int w, int h, int subdivided )
+{
+	memset(k, 0, sizeof(tile_key));
+	k->pixel_x = v->scale / width;
+	k->pixel_y = v->scale * v->aspect / height;
+	k->maxiter = v->maxiter;
+	k->w = w;
+	k->h = h;
+	k->subdivided = subdivided;
+	k->x = quantize(v->xcenter / k->pixel_x + (x - width/2.0));
+	k->y = quantize(v->ycenter / k->pixel_y + (y - height/2.0));
+}
+
+static unsigned int key_hash( const tile_key *k )
+{
+	unsigned long long words[] = {
+		(unsigned long long) k->x, (unsigned long long) (k->x >> 32 >> 32),
+		(unsigned long long) k->y, (unsigned long long) (k->y >> 32 >> 32),
+		(unsigned long long) k->maxiter << 32 | (unsigned) (k->w << 16 | k->h),
+		(unsigned long long) k->subdivided,
+	};
+	unsigned long long h = 14695981039346656037ull;
+	unsigned int i;
+	double d[2] = { k->pixel_x, k->pixel_y };
+
+	for (i=0; i<sizeof(words)/sizeof(words[0]); i++) {
+		h = (h ^ words[i]) * 1099511628211ull;
+	}
+	for (i=0; i<2; i++) {
+		unsigned long long bits;
+		memcpy(&bits, &d[i], sizeof(bits));
+		h = (h ^ bits) * 1099511628211ull;
+	}
+	return (unsigned int) (h ^ h >> 32);
+}
+
+static int key_equal( const tile_key *a, const tile_key *b )
+{
+	return a->x == b->x && a->y == b->y && a->w == b->w && a->h == b->h
+		&& a->maxiter == b->maxiter && a->subdivided == b->subdivided && a->pixel_x == b->pixel_x && a->pixel_y == b->pixel_y;
+}
+
+static void unlink_entry( tilecache *c, tile_entry *e )
+{
+	if (e->newer) e->newer->older = e->older;
+	else c->newest = e->older;
+	if (e->older) e->older->newer = e->newer;
+	else c->oldest = e->newer;
+	e->newer = e->older = 0;
+}
+
+static void link_newest( tilecache *c, tile_entry *e )
+{
+	e->older = c->newest;
+	e->newer = 0;
+	if (c->newest) c->newest->newer = e;
+	else c->oldest = e;
+	c->newest = e;
+}
+
+// Return the bucket link that points at the entry for k, or at the end of its chain
+static tile_entry **find_link( tilecache *c, const tile_key *k )
+{
+	tile_entry **link = &c->buckets[key_hash(k) % c->num_buckets];
+
+	while (*link && !key_equal(&(*link)->key, k)) {
+		link = &(*link)->next_in_bucket;
+	}
+	return link;
+}
+
+static void remove_entry( tilecache *c, tile_entry *e )
+{
+	tile_entry **link = find_link(c, &e->key);
+
+	*link = e->next_in_bucket;
+	unlink_entry(c, e);
+	c->bytes -= e->bytes;
+	c->count--;
+	free(e);
+}
+
+// Keep the chains short by doubling the table once it is as full as it has buckets
+static void grow_buckets( tilecache *c )
+{
+	int n = c->num_buckets ? 2*c->num_buckets : 1024;
+	tile_entry **buckets = (tile_entry **) calloc (n, sizeof(tile_entry *));
+	tile_entry *e;
+
+	if (!buckets) {
+		fprintf(stderr, "tilecache_insert: out of memory.\n");
+		exit(1);
+	}
+	free(c->buckets);
+	c->buckets = buckets;
+	c->num_buckets = n;
+
+	for (e=c->newest; e; e=e->older) {
+		tile_entry **link = &c->buckets[key_hash(&e->key) % n];
+		e->next_in_bucket = *link;
+		*link = e;
+	}
+}
+
+const int *tilecache_find( tilecache *c, const tile_key *k, const float **fracs )
+{
+	tile_entry *e = c->count ? *find_link(c, k) : 0;
+
+	if (!e) {
+		c->misses++;
+		return 0;
+	}
+	c->hits++;
+	unlink_entry(c, e);
+	link_newest(c, e);
+	*fracs = (const float *) &e->iters[k->w*k->h];
+	return e->iters;
+}
+
+void tilecache_insert( tilecache *c, const tile_key *k, const int *iters, const float *fracs, int stride )
+{
+	size_t bytes = sizeof(tile_entry) + (size_t) k->w * k->h * (sizeof(int) + sizeof(float));
+	tile_entry *e;
+	float *e_fracs;
+	int j;
+
+	if (bytes > c->budget) {
+		return;
+	}
+	if (c->count >= c->num_buckets) {
+		grow_buckets(c);
+	}
+
+	e = *find_link(c, k);
+	if (e) {
+		remove_entry(c, e);
+	}
+	while (c->bytes + bytes > c->budget) {
+		remove_entry(c, c->oldest);
+	}
+
+	e = (tile_entry *) malloc (bytes);
+	if (!e) {
+		fprintf(stderr, "tilecache_insert: out of memory.\n");
+		exit(1);
+	}
+	e->key = *k;
+	e->bytes = bytes;
+	e_fracs = (float *) &e->iters[k->w*k->h];
+	for (j=0; j<k->h; j++) {
+		memcpy(&e->iters[j*k->w], &iters[j*stride], k->w*sizeof(int));
+		memcpy(&e_fracs[j*k->w], &fracs[j*stride], k->w*sizeof(float));
+	}
+
+	tile_entry **link = find_link(c, k);
+	e->next_in_bucket = *link;
+	*link = e;
+	link_newest(c, e);
+	c->bytes += bytes;
+	c->count++;
+}
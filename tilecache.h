@@ -0,0 +1,76 @@
+/*
+tilecache.h - Least recently used cache of iteration-count tiles
+Keeps the counts of tiles from earlier frames, so going back to a
+view already seen (zooming out and in again, panning back) serves
+its tiles from memory instead of computing them again.
+*/
+
+#ifndef TILECACHE_H
+#define TILECACHE_H
+
+#include "view.h"
+
+#include <stddef.h>
+
+/*
+A tile is keyed on the spacing of its pixels, maxiter, its size, the
+position of its top left pixel in units of pixels from the origin of
+the complex plane, rounded to 1/TILECACHE_QUANTUM of a pixel, and
+whether it was drawn by subdivision, whose filled rectangles are not
+the counts of every pixel.  The position needs more than 64 bits on
+deep zooms.
+*/
+#define TILECACHE_QUANTUM 1024
+
+#ifdef __SIZEOF_INT128__
+typedef __int128 tile_coord;
+#else
+typedef long long tile_coord;
+#endif
+
+typedef struct {
+	double pixel_x;
+	double pixel_y;
+	int maxiter;
+	int w;
+	int h;
+	int subdivided;
+	tile_coord x;
+	tile_coord y;
+} tile_key;
+
+typedef struct tile_entry tile_entry;
+
+typedef struct {
+	tile_entry **buckets;
+	int num_buckets;
+	int count;
+	tile_entry *newest;
+	tile_entry *oldest;
+	size_t bytes;
+	size_t budget;
+	long hits;
+	long misses;
+} tilecache;
+
+/* Create an empty cache that holds up to budget bytes of tiles, or none with a budget of 0. */
+void tilecache_init( tilecache *c, size_t budget );
+
+/* Make the key of the w by h tile at pixel (x,y) of a width by height frame of the view, drawn by subdivision or not. */
+void tilecache_key( tile_key *k, const viewport *v, int width, int height, int x, int y, int w, int h, int subdivided );
+
+/*
+Look a tile up, counting a hit or a miss.  Return its w*h counts, row
+by row, setting fracs to the fractions of the counts, or return 0 if it
+is not cached.  Both stay valid until the next tilecache_insert.
+*/
+const int *tilecache_find( tilecache *c, const tile_key *k, const float **fracs );
+
+/*
+Store a tile, copying its counts and their fractions from rows of
+stride elements, and drop the least recently used tiles to stay within
+the budget.
+*/
+void tilecache_insert( tilecache *c, const tile_key *k, const int *iters, const float *fracs, int stride );
+
+#endif
@@ -0,0 +1,153 @@
+/*
+view.c - Viewport shared by fractal.c, fractalthread.c and fractaltask.c
+*/
+
+#include "view.h"
+
+#include <stdio.h>
+#include <ctype.h>
+
+/*
+scale is the width of the view in the complex plane, and aspect is its
+height divided by its width.  The aspect is fixed when the view is set
+up, so the shape of the image never changes as the user zooms.
+*/
+
+void view_init( viewport *v, double xmin, double xmax, double ymin, double ymax, int maxiter )
+{
+	v->xcenter = ((view_real) xmin + xmax) / 2; 
+	v->ycenter = ((view_real) ymin + ymax) / 2; 
+	v->scale = xmax - xmin; 
+	v->aspect = (ymax - ymin) / (xmax - xmin); 
+	v->maxiter = maxiter; 
+}
+
+void view_set_center( viewport *v, view_real xcenter, view_real ycenter, double scale )
+{
+	v->xcenter = xcenter; 
+	v->ycenter = ycenter; 
+	v->scale = scale; 
+}
+
+void view_bounds( const viewport *v, double *xmin, double *xmax, double *ymin, double *ymax )
+{
+	double xhalf = v->scale / 2; 
+	double yhalf = v->scale * v->aspect / 2; 
+
+	*xmin = v->xcenter - xhalf; 
+	*xmax = v->xcenter + xhalf; 
+	*ymin = v->ycenter - yhalf; 
+	*ymax = v->ycenter + yhalf; 
+}
+
+void view_move( viewport *v, double dx, double dy )
+{
+	v->xcenter += dx * v->scale; 
+	v->ycenter += dy * v->scale * v->aspect; 
+}
+
+void view_zoom( viewport *v, double factor )
+{
+	v->scale *= factor; 
+}
+
+// The offsets are small, so doubles hold them exactly enough; only the sum needs view_real
+void view_recenter( viewport *v, int x, int y, int width, int height )
+{
+	v->xcenter += ((double) x / width - 0.5) * v->scale; 
+	v->ycenter += ((double) y / height - 0.5) * v->scale * v->aspect; 
+}
+
+void view_change_maxiter( viewport *v, int factor )
+{
+	v->maxiter = v->maxiter > VIEW_MAX_ITER / factor ? VIEW_MAX_ITER : v->maxiter * factor; 
+}
+
+/*
+Write x as a double and a small correction, which together hold all of
+its digits.  The correction is taken from the decimal digits printed for
+the double, rather than the double itself, so parsing the sum back
+gives x again.
+*/
+static void format_real( view_real x, char *buf, size_t size )
+{
+	view_real hi; 
+	int n = snprintf(buf, size, "%.17g", (double) x); 
+
+	view_parse_real(buf, &hi); 
+	snprintf(buf+n, size-n, "%+.17g", (double) (x - hi)); 
+}
+
+void view_print( const viewport *v )
+{
+	double xmin, xmax, ymin, ymax; 
+	char x[64], y[64]; 
+
+	view_bounds(v, &xmin, &xmax, &ymin, &ymax); 
+	format_real(v->xcenter, x, sizeof(x)); 
+	format_real(v->ycenter, y, sizeof(y)); 
+	printf("coordinates: %lf %lf %lf %lf\n", xmin, xmax, ymin, ymax); 
+	printf("center: %s,%s,%.17g maxiter %d\n", x, y, v->scale, v->maxiter); 
+}
+
+// Parse one decimal number, digit by digit, so no precision is lost to a double
+static int parse_decimal( const char *s, view_real *x )
+{
+	const char *p = s; 
+	view_real value = 0; 
+	int negative = 0, digits = 0, exponent = 0; 
+
+	if (*p == '+' || *p == '-') {
+		negative = *p++ == '-'; 
+	}
+	for (; isdigit((unsigned char) *p); p++, digits++) {
+		value = value*10 + (*p - '0'); 
+	}
+	if (*p == '.') {
+		for (p++; isdigit((unsigned char) *p); p++, digits++) {
+			value = value*10 + (*p - '0'); 
+			exponent--; 
+		}
+	}
+	if (!digits) {
+		return 0; 
+	}
+	if ((*p == 'e' || *p == 'E') && (isdigit((unsigned char) p[1]) || ((p[1] == '+' || p[1] == '-') && isdigit((unsigned char) p[2])))) {
+		int e = 0, eneg = 0; 
+		p++; 
+		if (*p == '+' || *p == '-') {
+			eneg = *p++ == '-'; 
+		}
+		for (; isdigit((unsigned char) *p); p++) {
+			if (e < 100000) e = e*10 + (*p - '0'); 
+		}
+		exponent += eneg ? -e : e; 
+	}
+
+	// Scale by the power of ten, by repeated squaring
+	view_real power = 1, ten = 10; 
+	int n = exponent < 0 ? -exponent : exponent; 
+	for (; n; n >>= 1, ten *= ten) {
+		if (n & 1) power *= ten; 
+	}
+	value = exponent < 0 ? value / power : value * power; 
+
+	*x = negative ? -value : value; 
+	return p - s; 
+}
+
+int view_parse_real( const char *s, view_real *x )
+{
+	view_real term; 
+	int used = parse_decimal(s, x); 
+	int n; 
+
+	if (!used) {
+		return 0; 
+	}
+	while ((s[used] == '+' || s[used] == '-') && (n = parse_decimal(s+used, &term))) {
+		*x += term; 
+		used += n; 
+	}
+	return used; 
+}
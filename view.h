@@ -0,0 +1,70 @@
+/*
+view.h - Viewport shared by fractal.c, fractalthread.c and fractaltask.c
+The view is kept as a center point, a scale and maxiter, and the
+navigation commands change it in place, so every command builds
+on the one before.
+*/
+
+#ifndef VIEW_H
+#define VIEW_H
+
+/*
+The highest maxiter, for -m and the 'm' command alike.  The palette
+and its histograms take memory in proportion to maxiter.
+*/
+#define VIEW_MAX_ITER 10000000
+
+/*
+The center is kept in quad precision where the compiler has it, so deep
+zooms can move around long after the scale is too small for a double
+to tell neighboring pixels apart.
+*/
+#ifdef __SIZEOF_FLOAT128__
+typedef __float128 view_real; 
+#else
+typedef long double view_real; 
+#endif
+
+typedef struct {
+	view_real xcenter; 
+	view_real ycenter; 
+	double scale; 
+	double aspect; 
+	int maxiter; 
+} viewport; 
+
+/* Set up a view of the range (xmin-xmax,ymin-ymax) with the given maxiter. */
+void view_init( viewport *v, double xmin, double xmax, double ymin, double ymax, int maxiter );
+
+/* Move the view to the given center and width, keeping its aspect and maxiter. */
+void view_set_center( viewport *v, view_real xcenter, view_real ycenter, double scale );
+
+/* Return the range of the complex plane covered by the view, rounded to doubles. */
+void view_bounds( const viewport *v, double *xmin, double *xmax, double *ymin, double *ymax );
+
+/* Move the view by the given fractions of its width and height. */
+void view_move( viewport *v, double dx, double dy );
+
+/* Zoom about the center: a factor below 1 zooms in, above 1 zooms out. */
+void view_zoom( viewport *v, double factor );
+
+/* Move the center to pixel (x,y) of a width by height window, keeping the scale. */
+void view_recenter( viewport *v, int x, int y, int width, int height );
+
+/* Multiply maxiter by the given factor, up to VIEW_MAX_ITER. */
+void view_change_maxiter( viewport *v, int factor );
+
+/*
+Print the view, both as coordinates for -v and, to full precision,
+as the center and width for -c.
+*/
+void view_print( const viewport *v );
+
+/*
+Parse a number written as a decimal, or as a sum of decimals like
+the ones view_print writes, to the full precision of view_real.
+Return the number of characters used, or 0 if there is no number.
+*/
+int view_parse_real( const char *s, view_real *x );
+
+#endif